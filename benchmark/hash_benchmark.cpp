@@ -0,0 +1,201 @@
+// Measures hashing throughput of each read strategy, and of the tree hash at increasing thread
+// counts, on generated files.
+//
+//   hash_benchmark [--dir DIR] [--sizes 100M,1G,10G] [--repeat N] [--keep]
+//
+// Every run is preceded by dropping the file from the page cache, so the numbers reflect storage
+// plus digest throughput rather than memcpy speed.  A warm run is also reported for comparison.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <just_annotate/hash.h>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+uint64_t parseSize(const std::string& text) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    switch (*end) {
+        case 'k':
+        case 'K':
+            return value * 1e3;
+        case 'm':
+        case 'M':
+            return value * 1e6;
+        case 'g':
+        case 'G':
+            return value * 1e9;
+        default:
+            return value;
+    }
+}
+
+std::string formatSize(uint64_t size) {
+    char buffer[32];
+    if (size >= 1000000000) {
+        snprintf(buffer, sizeof(buffer), "%gG", size / 1e9);
+    }
+    else {
+        snprintf(buffer, sizeof(buffer), "%gM", size / 1e6);
+    }
+    return buffer;
+}
+
+bool generateFile(const std::string& path, uint64_t size) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    // xorshift output so that neither the file system nor the drive can compress the data
+    std::vector<uint64_t> block((8 << 20) / sizeof(uint64_t));
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    uint64_t written = 0;
+    while (written < size) {
+        for (auto& value: block) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            value = state;
+        }
+        size_t length = std::min<uint64_t>(block.size() * sizeof(uint64_t), size - written);
+        if (fwrite(block.data(), 1, length, file) != length) {
+            fclose(file);
+            return false;
+        }
+        written += length;
+    }
+
+    fflush(file);
+    fdatasync(fileno(file));
+    fclose(file);
+    return true;
+}
+
+void dropFromPageCache(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+double measure(const std::string& path, uint64_t size, HashReadStrategy strategy,
+               unsigned int tree_threads, bool cold)
+{
+    if (cold) {
+        dropFromPageCache(path);
+    }
+
+    // a tree thread count of 0 selects the flat sha256 with the given read strategy
+    auto start = std::chrono::steady_clock::now();
+    std::string hash = tree_threads == 0 ? sha256(path, {}, strategy)
+                                         : sha256Tree(path, {}, tree_threads);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (hash.empty()) {
+        return 0;
+    }
+
+    return size / elapsed.count() / 1e9;
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = fs::temp_directory_path().string();
+    std::vector<uint64_t> sizes = {100000000, 1000000000, 10000000000};
+    int repeat = 3;
+    bool keep = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        }
+        else if (arg == "--sizes" && i + 1 < argc) {
+            sizes.clear();
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                sizes.push_back(parseSize(item));
+            }
+        }
+        else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--keep") {
+            keep = true;
+        }
+        else {
+            printf("usage: %s [--dir DIR] [--sizes 100M,1G,10G] [--repeat N] [--keep]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const std::vector<HashReadStrategy> strategies = {
+        HashReadStrategy::STREAM, HashReadStrategy::PREAD, HashReadStrategy::MMAP,
+        HashReadStrategy::AUTO};
+
+    printf("%-8s %-8s %12s %12s\n", "size", "strategy", "cold GB/s", "warm GB/s");
+    for (auto size: sizes) {
+        std::string path = dir + "/just_annotate_hash_benchmark_" + formatSize(size) + ".bin";
+
+        std::error_code ec;
+        if (!fs::exists(path) || fs::file_size(path) != size) {
+            auto space = fs::space(dir, ec);
+            if (ec || space.available < size) {
+                spdlog::warn("Skipping {}: not enough free space in {}", formatSize(size), dir);
+                continue;
+            }
+
+            spdlog::info("Generating {} ...", path);
+            if (!generateFile(path, size)) {
+                spdlog::error("Failed to generate: {}", path);
+                continue;
+            }
+        }
+
+        for (auto strategy: strategies) {
+            double cold = 0;
+            double warm = 0;
+            for (int i = 0; i < repeat; i++) {
+                cold = std::max(cold, measure(path, size, strategy, 0, true));
+                warm = std::max(warm, measure(path, size, strategy, 0, false));
+            }
+            printf("%-8s %-8s %12.2f %12.2f\n", formatSize(size).c_str(),
+                   toString(strategy).c_str(), cold, warm);
+        }
+
+        // tree hash scaling from one thread up to one per core
+        unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+            double cold = 0;
+            double warm = 0;
+            for (int i = 0; i < repeat; i++) {
+                cold = std::max(cold, measure(path, size, HashReadStrategy::AUTO, threads, true));
+                warm = std::max(warm, measure(path, size, HashReadStrategy::AUTO, threads, false));
+            }
+            std::string label = "tree/" + std::to_string(threads);
+            printf("%-8s %-8s %12.2f %12.2f\n", formatSize(size).c_str(), label.c_str(), cold, warm);
+
+            if (threads == max_threads) {
+                break;
+            }
+        }
+
+        if (!keep) {
+            fs::remove(path, ec);
+        }
+    }
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <deque>
 #include <map>
 #include <memory>
@@ -8,6 +9,7 @@
 #include <vector>
 
 #include <imgui.h>
+#include <just_annotate/hash.h>
 
 struct AnnotationClass {
     int id = 0;
@@ -25,6 +27,10 @@ struct FileAnnotations {
     using ConstPtr = std::shared_ptr<const FileAnnotations>;
 
     std::string hash;
+    std::string hash_algorithm = HASH_SHA256;
+    std::string fingerprint;
+    // size in bytes, 0 if unknown
+    uint64_t size = 0;
     std::set<std::string> names;
     std::vector<Annotations> annotations;
 };
@@ -57,8 +63,25 @@ class AnnotationStore {
 
     const std::string& getPath() const;
 
-    void setFile(const std::string& name, const std::string& hash);
+    // Selects the file matching any of the given hashes, or adds a new one identified by the hash
+    // of the preferred algorithm.
+    void setFile(const std::string& name, const FileHashes& hashes,
+                 const std::string& preferred_algorithm, const std::string& fingerprint = {});
+    bool setFileByFingerprint(const std::string& fingerprint);
+    void clearFile();
     bool hasFile() const;
+    bool matchesFile(const FileHashes& hashes) const;
+    std::string getFileHash() const;
+    std::set<std::string> getHashAlgorithms() const;
+
+    // Last known location of each file, keyed by its hash, so that a project can be reopened
+    // without browsing for every video.
+    void setFileLocation(const std::string& path, uint64_t size);
+    void setFileLocations(const std::map<std::string, std::string>& locations);
+    std::string getFileLocation(const std::string& hash) const;
+    std::vector<FileAnnotations> getFiles() const;
+    // Files without a known location, or whose location no longer exists.
+    std::vector<FileAnnotations> getMissingFiles() const;
 
     bool setAnnotations(const Annotations& annotations);
     std::vector<Annotations> getAnnotations();
@@ -72,9 +95,14 @@ class AnnotationStore {
     bool restoreAnnotationClass(int deleted_id, int new_id);
 
   private:
+    FileAnnotations::Ptr findFile(const FileHashes& hashes) const;
+
     std::string path_;
     std::map<int, AnnotationClass> annotation_classes_;
-    std::map<std::string, FileAnnotations::Ptr> annotations_;
+    // (hash algorithm, hash) -> file
+    std::map<std::pair<std::string, std::string>, FileAnnotations::Ptr> annotations_;
     FileAnnotations::Ptr current_annotations_;
+    // hash -> path
+    std::map<std::string, std::string> locations_;
     bool is_dirty_ = false;
 };
@@ -2,6 +2,7 @@
 
 #include <deque>
 #include <string>
+#include <vector>
 
 struct ConfigState {
     std::deque<std::string> recent_files;
@@ -11,14 +12,23 @@ struct ConfigState {
     int window_height = 720;
     int window_x = -1;
     int window_y = -1;
+    std::string hash_read_strategy = "auto";
+    std::string hash_algorithm = "sha256";
+    std::vector<std::string> search_roots;
+    int frame_cache_mb = 512;
+    int frame_memory_mb = 64;
+    bool gl_output = false;
 
     bool operator==(const ConfigState& other) const;
     bool operator!=(const ConfigState& other) const;
 
     void addRecentFile(const std::string& path);
     void addRecentVideo(const std::string& path);
+    void addSearchRoot(const std::string& path);
 };
 
+std::string findConfigDir();
+
 ConfigState getConfig();
 
 bool saveConfig(const ConfigState& config);
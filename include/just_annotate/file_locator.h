@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <just_annotate/annotation_store.h>
+#include <just_annotate/hash_cache.h>
+
+// Finds the videos of a project that have moved, by searching a set of root directories on a
+// background thread.  Candidates are narrowed down by file name and size first, and only those are
+// hashed, in parallel, to confirm that their content matches.
+class FileLocator {
+  public:
+    explicit FileLocator(const HashCache::Ptr& hash_cache);
+    ~FileLocator();
+
+    void start(const std::vector<FileAnnotations>& files, const std::vector<std::string>& roots,
+               unsigned int num_threads = 0);
+    void cancel();
+
+    bool isBusy() const;
+    size_t getTotal() const;
+    size_t getCompleted() const;
+
+    // Returns true once for each finished search, filling in the hash -> path of the files found.
+    bool poll(std::map<std::string, std::string>& locations);
+
+  private:
+    struct Candidate {
+        std::string path;
+        // indices of the files this candidate could be
+        std::vector<size_t> files;
+        bool name_match = false;
+    };
+
+    void run(std::vector<FileAnnotations> files, std::vector<std::string> roots,
+             unsigned int num_threads);
+    bool matches(const std::string& path, const FileAnnotations& file);
+
+    HashCache::Ptr hash_cache_;
+    mutable std::mutex mutex_;
+    std::thread thread_;
+    std::map<std::string, std::string> locations_;
+    std::atomic<bool> cancel_{false};
+    std::atomic<bool> busy_{false};
+    std::atomic<bool> finished_{false};
+    std::atomic<size_t> total_{0};
+    std::atomic<size_t> completed_{0};
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+typedef struct _GstBuffer GstBuffer;
+typedef struct _GstElement GstElement;
+typedef struct _GstSample GstSample;
+
+namespace just_annotate {
+
+// Decoded frames indexed by presentation timestamp in nanoseconds.  Frames are evicted least
+// recently used first once the total size exceeds the memory budget.
+class FrameCache {
+  public:
+    using Ptr      = std::shared_ptr<FrameCache>;
+    using ConstPtr = std::shared_ptr<const FrameCache>;
+
+    struct Frame {
+        int64_t pts = -1;
+        int64_t duration = 0;
+        int width = 0;
+        int height = 0;
+        // a GstVideoFormat
+        int format = 0;
+        // holds a reference that the caller has to release with gst_buffer_unref()
+        GstBuffer* buffer = nullptr;
+    };
+
+    explicit FrameCache(size_t max_bytes);
+    ~FrameCache();
+
+    void setMaxBytes(size_t max_bytes);
+    size_t getMaxBytes() const;
+    size_t getBytes() const;
+    size_t size() const;
+
+    // Adds a reference to the buffer, replacing any frame with the same timestamp.
+    void insert(int64_t pts, int64_t duration, int width, int height, int format,
+                GstBuffer* buffer);
+    // Adds the frame of a decoded sample under its stream time, which is returned, or -1 if the
+    // sample has no usable timestamp or caps.
+    int64_t insert(GstSample* sample);
+    void clear();
+
+    // Stream time of the frame of a decoded sample, or -1 if it has no usable timestamp.
+    static int64_t getStreamTime(GstSample* sample);
+
+    // The frame displayed at the given time.
+    bool find(int64_t time, Frame& frame);
+    // The frames directly after and before the one with the given timestamp.  Returns false if the
+    // neighbour isn't cached, so that a gap is never skipped over.
+    bool next(int64_t pts, Frame& frame);
+    bool previous(int64_t pts, Frame& frame);
+    // Timestamp of the earliest frame in the unbroken run of cached frames that ends with the given
+    // one, or -1 if the frame itself isn't cached.
+    int64_t contiguousStart(int64_t pts) const;
+
+  private:
+    struct Entry {
+        int64_t duration = 0;
+        int width = 0;
+        int height = 0;
+        int format = 0;
+        size_t bytes = 0;
+        GstBuffer* buffer = nullptr;
+        std::list<int64_t>::iterator lru_it;
+    };
+
+    bool get(std::map<int64_t, Entry>::iterator it, Frame& frame);
+    void evict();
+
+    mutable std::mutex mutex_;
+    size_t max_bytes_ = 0;
+    size_t bytes_ = 0;
+    std::map<int64_t, Entry> entries_;
+    // most recently used first
+    std::list<int64_t> lru_;
+};
+
+// Decodes a window of frames into a frame cache with a separate pipeline on a background thread,
+// so that the frames around a paused video are ready before they are stepped to.
+class FramePrefetcher {
+  public:
+    // Frames are decoded into the given caps, the same as the frames of the playback pipeline.
+    FramePrefetcher(const std::string& uri, const std::string& caps,
+                    const FrameCache::Ptr& frame_cache);
+    ~FramePrefetcher();
+
+    // Decodes the frames between start and end, in nanoseconds, replacing any request in progress.
+    // With from_keyframe set, decoding starts at the keyframe before start instead, so that a whole
+    // GOP is decoded once without the frames before start being dropped.
+    void request(int64_t start, int64_t end, bool from_keyframe = false);
+    void cancel();
+    bool isBusy() const;
+
+  private:
+    bool createPipeline();
+    void run();
+
+    std::string uri_;
+    std::string caps_;
+    FrameCache::Ptr frame_cache_;
+    GstElement* pipeline_ = nullptr;
+    GstElement* framesink_ = nullptr;
+
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread thread_;
+    int64_t start_ = -1;
+    int64_t end_ = -1;
+    bool from_keyframe_ = false;
+    bool pending_ = false;
+    std::atomic<bool> busy_{false};
+    std::atomic<bool> abort_{false};
+    bool exit_ = false;
+};
+
+} // namespace just_annotate
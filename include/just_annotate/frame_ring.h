@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+typedef struct _GstBuffer GstBuffer;
+
+namespace just_annotate {
+
+// Hands decoded frames from the streaming thread that produces them to the UI thread without
+// locking.  There must be exactly one thread pushing and one popping.
+class FrameRing {
+  public:
+    struct Frame {
+        // holds a reference, which passes to whoever pops the frame
+        GstBuffer* buffer = nullptr;
+        // stream time in nanoseconds, -1 if unknown
+        int64_t pts = -1;
+        // running time in nanoseconds from which the frame is due on screen and at which the next
+        // one is, -1 if unknown
+        int64_t running_time = -1;
+        int64_t running_end = -1;
+        // steady clock time in nanoseconds at which the frame was handed over
+        int64_t arrival = 0;
+        int width = 0;
+        int height = 0;
+        // a GstVideoFormat
+        int format = 0;
+    };
+
+    // The capacity is rounded up to a power of two.
+    explicit FrameRing(size_t capacity);
+    ~FrameRing();
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    // Returns false, leaving the frame with the caller, if the ring is full.
+    bool push(const Frame& frame);
+    bool pop(Frame& frame);
+    // Releases all queued frames, only from the popping thread.
+    void clear();
+
+    size_t getDropped() const;
+    void countDropped();
+
+  private:
+    std::vector<Frame> slots_;
+    size_t mask_ = 0;
+    // written by the pushing thread only
+    std::atomic<size_t> head_{0};
+    // written by the popping thread only
+    std::atomic<size_t> tail_{0};
+    std::atomic<size_t> dropped_{0};
+};
+
+} // namespace just_annotate
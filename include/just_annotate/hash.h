@@ -1,6 +1,50 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <string>
 
-std::string sha256(const std::string& path);
-std::string md5sum(const std::string& path);
+// Called periodically with the number of bytes hashed so far and the file size.  Returning false
+// cancels the hash, in which case an empty string is returned.
+using HashProgressCallback = std::function<bool(uint64_t bytes_read, uint64_t total_bytes)>;
+
+// How file contents are read while hashing.  AUTO uses mmap for local files and large aligned
+// pread() calls for network and FUSE mounts, where page faults are expensive.
+enum class HashReadStrategy
+{
+    AUTO = 0,
+    STREAM = 1,
+    MMAP = 2,
+    PREAD = 3
+};
+
+std::string toString(HashReadStrategy strategy);
+HashReadStrategy hashReadStrategyFromString(const std::string& name);
+
+// Identity algorithms, recorded next to each hash in the project file.
+const std::string HASH_SHA256      = "sha256";
+const std::string HASH_SHA256_TREE = "sha256-tree";
+
+// hash algorithm -> hash of one file
+typedef std::map<std::string, std::string> FileHashes;
+
+std::string sha256(const std::string& path, const HashProgressCallback& progress = {},
+                   HashReadStrategy strategy = HashReadStrategy::AUTO);
+
+// Merkle tree of sha256 digests over fixed size chunks, laid out like BLAKE3, so that the chunks can
+// be read and hashed on all cores.  A thread count of 0 uses one thread per core.
+const uint64_t TREE_CHUNK_SIZE = 1 << 20;
+std::string sha256Tree(const std::string& path, const HashProgressCallback& progress = {},
+                       unsigned int num_threads = 0);
+
+std::string hashFile(const std::string& path, const std::string& algorithm,
+                     const HashProgressCallback& progress = {},
+                     HashReadStrategy strategy = HashReadStrategy::AUTO);
+
+// Quick identity of a video from its size plus fixed size chunks at the head, middle and tail.
+// Runs in constant time regardless of file length, but should be confirmed with the full sha256.
+const uint64_t FINGERPRINT_CHUNK_SIZE = 1 << 20;
+std::string fingerprint(const std::string& path);
+
+std::string md5sum(const std::string& path, HashReadStrategy strategy = HashReadStrategy::AUTO);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <just_annotate/hash.h>
+
+struct HashCacheEntry {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t inode = 0;
+
+    FileHashes hashes;
+
+    // true if the file no longer exists or its size, mtime or inode have changed
+    bool isStale() const;
+};
+
+bool statFile(const std::string& path, HashCacheEntry& entry);
+std::string normalizePath(const std::string& path);
+
+class HashCache {
+  public:
+    using Ptr      = std::shared_ptr<HashCache>;
+    using ConstPtr = std::shared_ptr<const HashCache>;
+
+    HashCache() = default;
+    ~HashCache() = default;
+
+    static HashCache::Ptr open();
+    static HashCache::Ptr open(const std::string& path);
+    bool save();
+
+    const std::string& getPath() const;
+
+    std::string getHash(const std::string& path, const std::string& algorithm = HASH_SHA256) const;
+    // stored only if the file still matches the stat taken before hashing, returns false otherwise
+    bool setHash(const std::string& path, const HashCacheEntry& before, const std::string& hash,
+                 const std::string& algorithm = HASH_SHA256);
+
+    std::vector<HashCacheEntry> getEntries() const;
+    size_t prune();
+
+  private:
+    std::string path_;
+    mutable std::mutex mutex_;
+    std::mutex save_mutex_;
+    std::map<std::string, HashCacheEntry> entries_;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <imgui.h>
+#include <just_annotate/hash_cache.h>
+
+class HashCacheDialog {
+public:
+    HashCacheDialog() = default;
+    ~HashCacheDialog() = default;
+
+    void SetTitle(const std::string& title);
+    void Open(const HashCache::Ptr& cache);
+    void Display();
+
+private:
+    void Refresh();
+
+    std::string title_;
+    HashCache::Ptr cache_;
+    std::vector<HashCacheEntry> entries_;
+    std::vector<bool> stale_;
+    size_t last_pruned_ = 0;
+    bool has_pruned_ = false;
+};
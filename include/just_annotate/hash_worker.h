@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <just_annotate/hash.h>
+#include <just_annotate/hash_cache.h>
+
+// Hashes one video at a time on a background thread, with each of the requested algorithms.
+// Starting a new job cancels the one in flight so that switching videos never queues up stale work.
+class HashWorker {
+  public:
+    struct Result {
+        std::string path;
+        // empty if hashing failed
+        FileHashes hashes;
+        bool cancelled = false;
+    };
+
+    explicit HashWorker(const HashCache::Ptr& hash_cache);
+    ~HashWorker();
+
+    void setReadStrategy(HashReadStrategy strategy);
+
+    void start(const std::string& path, const std::set<std::string>& algorithms);
+    void cancel();
+
+    bool isBusy() const;
+    std::string getPath() const;
+    std::set<std::string> getAlgorithms() const;
+    float getProgress() const;
+
+    // Returns true once for each finished job, filling in its result.
+    bool poll(Result& result);
+
+  private:
+    struct Job {
+        std::string path;
+        std::set<std::string> algorithms;
+        std::atomic<bool> cancel{false};
+        std::atomic<float> progress{0.0f};
+        std::atomic<bool> done{false};
+        Result result;
+    };
+
+    void run(std::shared_ptr<Job> job);
+
+    HashCache::Ptr hash_cache_;
+    std::atomic<HashReadStrategy> read_strategy_{HashReadStrategy::AUTO};
+    mutable std::mutex mutex_;
+    std::shared_ptr<Job> job_;
+    std::thread thread_;
+    bool reported_ = true;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace just_annotate {
+
+// Stream times of the keyframes and of all frames of a video, in nanoseconds.  The index is built
+// on a background thread by parsing, not decoding, the file, and is cached on disk by the video's
+// fingerprint so that it's only built the first time a video is opened.
+class KeyframeIndex {
+  public:
+    using Ptr      = std::shared_ptr<KeyframeIndex>;
+    using ConstPtr = std::shared_ptr<const KeyframeIndex>;
+
+    ~KeyframeIndex();
+
+    static KeyframeIndex::Ptr open(const std::string& path);
+
+    bool isReady() const;
+    size_t size() const;
+
+    // The keyframe at or before the given time, or -1 if the index isn't ready.
+    int64_t keyframeBefore(int64_t time) const;
+    // The keyframe closest to the given time, or -1 if the index isn't ready.
+    int64_t keyframeNearest(int64_t time) const;
+
+    // Frames are numbered from 0 in presentation order, by their actual timestamps, so that
+    // variable frame rates are accounted for.  There are none until the index is ready.
+    size_t frameCount() const;
+    // The stream time of the given frame, or -1 if there's no such frame.
+    int64_t frameTime(int64_t frame) const;
+    // The frame shown at the given time, the last one starting at or before it, or -1 if the
+    // index isn't ready.
+    int64_t frameAt(int64_t time) const;
+
+  private:
+    KeyframeIndex() = default;
+
+    void run();
+    bool load();
+    bool build();
+    bool save() const;
+
+    std::string path_;
+    std::string cache_path_;
+    mutable std::mutex mutex_;
+    std::vector<int64_t> keyframes_;
+    std::vector<int64_t> frames_;
+    std::atomic<bool> ready_{false};
+    std::atomic<bool> cancel_{false};
+    std::thread thread_;
+};
+
+} // namespace just_annotate
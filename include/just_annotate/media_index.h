@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <just_annotate/hash_cache.h>
+
+typedef struct _GstDiscoverer GstDiscoverer;
+
+struct MediaInfo {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t inode = 0;
+
+    double duration = 0;
+    int width = 0;
+    int height = 0;
+    double frame_rate = 0;
+    std::string codec;
+    std::string fingerprint;
+
+    // true if the file no longer exists or its size, mtime or inode have changed
+    bool isStale() const;
+};
+
+// Persistent metadata of every video seen by a library scan, stored next to the config file.
+class MediaIndex {
+  public:
+    using Ptr      = std::shared_ptr<MediaIndex>;
+    using ConstPtr = std::shared_ptr<const MediaIndex>;
+
+    MediaIndex() = default;
+    ~MediaIndex() = default;
+
+    static MediaIndex::Ptr open();
+    static MediaIndex::Ptr open(const std::string& path);
+    bool save();
+
+    // Returns false if the file isn't indexed or has changed since.
+    bool getInfo(const std::string& path, MediaInfo& info) const;
+    void setInfo(const MediaInfo& info);
+    size_t size() const;
+
+    // Roots of scans that were interrupted, so they can be resumed on the next start.
+    std::set<std::string> getPendingRoots() const;
+    void addPendingRoot(const std::string& root);
+    void removePendingRoot(const std::string& root);
+
+  private:
+    std::string path_;
+    mutable std::mutex mutex_;
+    std::mutex save_mutex_;
+    std::map<std::string, MediaInfo> entries_;
+    std::set<std::string> pending_roots_;
+};
+
+// Walks a directory tree and fills the media index and hash cache for every video in it, using a
+// bounded pool of threads.  Files that are already indexed and hashed are skipped, so restarting an
+// interrupted scan picks up where it left off.
+class LibraryScanner {
+  public:
+    LibraryScanner(const MediaIndex::Ptr& media_index, const HashCache::Ptr& hash_cache);
+    ~LibraryScanner();
+
+    void start(const std::string& root, const std::set<std::string>& algorithms,
+               unsigned int num_threads = 0);
+    // Returns right away, the scan stops once the file being probed is done, which can take as
+    // long as the discoverer's timeout.  It stays busy until then.
+    void cancel();
+
+    bool isBusy() const;
+    std::string getRoot() const;
+    size_t getTotal() const;
+    size_t getCompleted() const;
+
+    // Returns true once each time a scan runs to completion.
+    bool poll();
+
+  private:
+    void run(std::string root, std::set<std::string> algorithms, unsigned int num_threads);
+    void join();
+    void indexFile(GstDiscoverer* discoverer, const std::string& path,
+                   const std::set<std::string>& algorithms);
+    void saveThrottled();
+
+    MediaIndex::Ptr media_index_;
+    HashCache::Ptr hash_cache_;
+    mutable std::mutex mutex_;
+    std::string root_;
+    std::deque<std::string> queue_;
+    std::thread thread_;
+    std::atomic<bool> cancel_{false};
+    std::atomic<bool> busy_{false};
+    std::atomic<bool> finished_{false};
+    std::atomic<size_t> total_{0};
+    std::atomic<size_t> completed_{0};
+    std::chrono::steady_clock::time_point last_save_;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace just_annotate {
+
+// Small frames sampled at regular intervals over a whole video, packed into one texture atlas for
+// drawing a filmstrip of the timeline.  They are decoded on a low priority background thread with a
+// pipeline of their own, and cached on disk by the video's fingerprint so that reopening a video
+// shows them straight away.
+class ThumbnailStrip {
+  public:
+    using Ptr      = std::shared_ptr<ThumbnailStrip>;
+    using ConstPtr = std::shared_ptr<const ThumbnailStrip>;
+
+    static const int THUMBNAIL_WIDTH = 160;
+    static const int THUMBNAIL_HEIGHT = 90;
+
+    // Texture coordinates of a thumbnail within the atlas.
+    struct Thumbnail {
+        double time = 0;
+        float u0 = 0;
+        float v0 = 0;
+        float u1 = 0;
+        float v1 = 0;
+    };
+
+    ~ThumbnailStrip();
+
+    static ThumbnailStrip::Ptr open(const std::string& path);
+
+    // Uploads thumbnails decoded since the last call, which has to be done on the GL thread.
+    void update();
+    uint32_t getTextureId() const;
+
+    bool isComplete() const;
+    size_t getCount() const;
+    // The decoded thumbnail closest to the given time in seconds, false if there is none yet.
+    bool find(double time, Thumbnail& thumbnail) const;
+
+  private:
+    ThumbnailStrip() = default;
+
+    void run();
+    bool load();
+    bool build();
+    bool save() const;
+    void setThumbnail(size_t index, const uint8_t* pixels);
+
+    std::string path_;
+    std::string cache_path_;
+
+    mutable std::mutex mutex_;
+    double duration_ = 0;
+    size_t count_ = 0;
+    int columns_ = 0;
+    int rows_ = 0;
+    std::vector<uint8_t> atlas_;
+    std::vector<bool> decoded_;
+    bool atlas_changed_ = false;
+
+    uint32_t texture_id_ = 0;
+    std::chrono::steady_clock::time_point last_upload_;
+    std::atomic<bool> complete_{false};
+    std::atomic<bool> cancel_{false};
+    std::thread thread_;
+};
+
+} // namespace just_annotate
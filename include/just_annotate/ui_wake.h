@@ -0,0 +1,16 @@
+#pragma once
+
+namespace just_annotate {
+
+// Lets background threads wake the UI thread while it sleeps waiting for events, when they have
+// something for it to show.  The handler is set once at startup, before any background thread
+// runs, and has to be safe to call from any thread, e.g. glfwPostEmptyEvent().
+void setWakeHandler(void (*handler)());
+
+// Marks whether the UI thread is about to sleep or has woken up again.  Wakes are only posted
+// while it's asleep, so that busy threads don't flood the event queue while it's drawing anyway.
+void setUiIdle(bool is_idle);
+
+void wakeUi();
+
+} // namespace just_annotate
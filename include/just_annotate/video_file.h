@@ -8,8 +8,122 @@
 #include <thread>
 #include <vector>
 
+#include <just_annotate/frame_cache.h>
+
+typedef struct _GstVideoFrame GstVideoFrame;
+
 namespace just_annotate {
 
+// Counters of how position changes were served, and the latency of the ones that went to the
+// pipeline, in milliseconds from issuing the seek to the first frame after it.
+struct SeekStats {
+    size_t pipeline_seeks = 0;
+    size_t cache_hits = 0;
+    // commands that were merged into or replaced by a later one before being executed
+    size_t coalesced = 0;
+    double last_ms = 0;
+    double mean_ms = 0;
+    double max_ms = 0;
+};
+
+// Time spent uploading decoded frames into the texture on the UI thread, in milliseconds.
+struct UploadStats {
+    size_t frames = 0;
+    // decoded frames that the UI thread didn't pick up before the hand-off ring was full
+    size_t dropped = 0;
+    double last_ms = 0;
+    double mean_ms = 0;
+    double max_ms = 0;
+};
+
+struct VideoOptions {
+    // A known duration, e.g. from the media index, makes the timeline usable before the pipeline
+    // has prerolled.  It is replaced by the queried duration once available.
+    double duration = 0;
+    // Keeps decoded frames in GL memory and draws them from GStreamer's textures, without copying
+    // them through system memory.  Needs VideoFile::initGL(), otherwise frames are converted in
+    // system memory as usual.
+    bool gl_output = false;
+    // Takes NV12 and I420 frames as decoded and converts them to RGB in a shader, rather than
+    // converting them to RGBA on the CPU, when the OpenGL context supports it.
+    bool yuv_upload = true;
+    // Threads of software decoders, 0 for one per core.  Decoders only read it when they open.
+    int decoder_threads = 0;
+};
+
+// How the decoder trades quality for speed.  AUTO follows what the player is doing: full quality
+// while paused and stepping, dropping late frames while playing, and skipping non-reference frames
+// while scrubbing.  The others hold one profile regardless, e.g. to compare them.
+enum class DecoderProfile {
+    AUTO,
+    QUALITY,
+    PLAYBACK,
+    SCRUB
+};
+
+// Frames decoded while a profile was active, and for how long the pipeline was busy decoding,
+// playing or waiting for a seek, meanwhile.
+struct DecoderStats {
+    DecoderProfile profile = DecoderProfile::QUALITY;
+    size_t frames = 0;
+    double busy_seconds = 0;
+};
+
+// Throughput at one output size.  Decoding is measured by the frames delivered per second of
+// playback, scaling and conversion between pad probes around them, and uploading on the UI thread.
+struct ResolutionStats {
+    int width = 0;
+    int height = 0;
+    size_t frames = 0;
+    size_t playing_frames = 0;
+    double playing_seconds = 0;
+    // totals over all frames
+    double convert_ms = 0;
+    double upload_ms = 0;
+};
+
+// Frames presented while playing, picked by the pipeline clock at the time the UI frame is expected
+// on screen, in milliseconds.
+struct PresentStats {
+    size_t presented = 0;
+    // frames that were superseded before a UI frame could show them
+    size_t dropped = 0;
+    // frames shown after the next one was already due, because it wasn't decoded in time
+    size_t late = 0;
+    // expected time from an update until the swap that shows it
+    double delay_ms = 0;
+    // from a frame being handed over until the swap that shows it, including the lead it's decoded
+    // with while playing
+    double latency_last_ms = 0;
+    double latency_mean_ms = 0;
+    double latency_max_ms = 0;
+};
+
+// Memory held by the decoded frames of a video, in bytes.
+struct FrameMemoryStats {
+    // frames kept after being displayed, the displayed one at least even beyond the budget
+    size_t retained_frames = 0;
+    size_t retained_bytes = 0;
+    size_t budget_bytes = 0;
+    size_t cache_frames = 0;
+    size_t cache_bytes = 0;
+    size_t cache_max_bytes = 0;
+    // frame buffers allocated rather than reused from a pool, which only grows while paused, until
+    // the frame cache is full
+    size_t allocations = 0;
+};
+
+// Time from opening a video until its first frame is shown, with a new pipeline and with one
+// reused from a closed video.
+struct OpenStats {
+    size_t cold_opens = 0;
+    double cold_mean_ms = 0;
+    size_t pooled_opens = 0;
+    double pooled_mean_ms = 0;
+    double last_ms = 0;
+    bool last_pooled = false;
+};
+
 class VideoFile {
   public:
     using Ptr      = std::shared_ptr<VideoFile>;
@@ -17,44 +131,157 @@ class VideoFile {
 
     ~VideoFile();
 
-    static VideoFile::Ptr open(const std::string& path);
+    // Reuses the pipeline of a closed video if there's one with the same output path, which
+    // keeps the converters, the sink and the textures and only swaps the URI.
+    static VideoFile::Ptr open(const std::string& path, const VideoOptions& options = {});
+    // Releases the pooled pipelines, while the OpenGL context is still current.
+    static void clearPool();
+    static OpenStats getOpenStats();
     static void init(int argc, char* argv[]);
+    // Shares the OpenGL context current on the calling thread with GStreamer, which GL output
+    // needs.  Only GLX contexts are supported.
+    static bool initGL();
 
     const std::string& getPath() const;
     float getDuration() const;
     int getWidth() const;
     int getHeight() const;
+    // 0 until the first frame of this video is shown.
     uint32_t getTextureId();
+    // Whether a frame of this video has been shown, which a reused pipeline's texture doesn't tell.
+    bool hasFrame() const;
+    bool isGLOutput() const;
     void handleFrames();
     bool isPaused() const;
+    // Paused with nothing in flight, so that the picture won't change until the next command.
+    // Frames and errors arriving otherwise wake the UI, see ui_wake.h.
+    bool isIdle() const;
+    // The time of the frame on screen.
     double getPosition() const;
 
+    // Frames are numbered from 0 in presentation order.  With the keyframe index ready they follow
+    // the actual frame timestamps, which also works for variable frame rates; until then they're
+    // estimated from the frame rate.  Frame numbers and times are -1 if unknown.
+    int64_t getFrameCount() const;
+    int64_t getFrameNumber(double time) const;
+    double getFrameTime(int64_t frame) const;
+    // The start of the frame shown at the given time.
+    double snapToFrame(double time) const;
+    int64_t getDisplayedFrame() const;
+
     void update();
 
     void play();
     void stop();
     void pause(bool is_paused);
     void seek(double position);
+    // Fast seek for dragging the position slider, which lands on the keyframe nearest to the
+    // position.  Call seek() with the final position once the drag ends.
+    void scrub(double position);
     void seekRelative(double offset);
     void step(bool forward);
     void setDirection(bool forward);
+    // Playback speed, negative for playing backwards, between 1/4x and 16x.  Above 2x only
+    // keyframes are decoded, slow motion decodes every frame.  Pausing returns to 1x.
+    void setRate(double rate);
+    double getRate() const;
+
+    // Frames are scaled down to the size they are displayed at, in pixels, to save converting and
+    // uploading pixels that aren't visible.  The output size is renegotiated once the displayed
+    // size has settled.
+    void setDisplaySize(int width, int height);
+    // Keeps the source resolution regardless of the displayed size, e.g. for inspecting pixels.
+    void setNativeResolution(bool native_resolution);
+    bool isNativeResolution() const;
+    std::vector<ResolutionStats> getResolutionStats() const;
+
+    void setDecoderProfile(DecoderProfile profile);
+    DecoderProfile getDecoderProfile() const;
+    // The profile applied at the moment, never AUTO.
+    DecoderProfile getActiveDecoderProfile() const;
+    std::vector<DecoderStats> getDecoderStats() const;
+
+    // Memory budget of the decoded frames kept for stepping and seeking while paused.
+    void setFrameCacheSize(size_t bytes);
+    // Memory budget of the frames kept referenced after being displayed.
+    void setFrameMemory(size_t bytes);
+    FrameMemoryStats getFrameMemoryStats() const;
+
+    SeekStats getSeekStats() const;
+
+    // Streams frames into the texture through pixel buffer objects rather than copying them
+    // directly, when the OpenGL implementation supports it.  Enabled by default.
+    void setPixelBufferUpload(bool enabled);
+    bool isPixelBufferUpload() const;
+    UploadStats getUploadStats() const;
+
+    // To be called after the buffers are swapped, which measures when the frames picked by update()
+    // reach the screen, and so which frame the next update has to pick.
+    void presented();
+    PresentStats getPresentStats() const;
 
     struct Impl;
 
   private:
+    // Seeks, scrubs, steps and rate changes are queued rather than executed while the pipeline is
+    // still busy with the previous one.  Only the latest command is kept, except that steps in the
+    // same direction add up, so that fast input never backs up behind a queue of stale seeks.
+    enum class CommandType { NONE, SEEK, SCRUB, STEP, RATE };
+    struct Command {
+        CommandType type = CommandType::NONE;
+        double position = 0;
+        bool forward = true;
+        int steps = 0;
+    };
+
     VideoFile();
+    void build(const std::string& path, const VideoOptions& options);
+    void reuse(const std::string& path);
+    // Returns the pipeline to the pool, unless it's full or the pipeline failed.
+    bool recycle();
+    // The running time at which the frame picked now will be on screen, -1 unless playing.
+    int64_t getPresentTime() const;
+    void discardPendingFrames();
     bool exiting();
+    void schedule(const Command& command);
+    void execute();
+    void waitForFrame();
+    // Flushing seek that plays on from the position at the current rate.
+    bool seekAtRate(int64_t position_ns);
+    void doSeek(double position);
+    void doScrub(double position);
+    // Returns the number of steps taken, which is 0 while waiting for frames to be decoded.
+    int doStep(bool forward, int steps);
+    // Restarts playing from the frame on screen at the latest rate.
+    void doRate();
+    void uploadFrame(GstBuffer* frame, int format, int width, int height);
+    void uploadPlane(uint32_t texture_id, const GstVideoFrame& frame, int plane,
+                     uint32_t gl_format, int pixel_size);
+    void showGLFrame(GstBuffer* frame);
+    void applyOutputSize();
+    void processBusEvents();
+    // Applies the selected profile, or the given one if AUTO is selected.
+    void applyDecoderProfile(DecoderProfile automatic);
+    void showCachedFrame(FrameCache::Frame& frame);
+    void prefetchFrames();
 
     std::string path_;
     int width_ = 0;
     int height_ = 0;
     double duration_ = 0;
+    bool duration_queried_ = false;
     double position_ = 0;
     uint32_t texture_id_ = 0;
     bool do_exit_ = false;
     bool is_paused_ = true;
-    double next_seek_ = -1;
     double last_seek_ = -1;
+    Command pending_command_;
+    // timestamp of the displayed frame in nanoseconds
+    int64_t displayed_pts_ = -1;
+    // true while the displayed frame came from the frame cache rather than the pipeline, which is
+    // then still positioned at an earlier frame
+    bool cache_served_ = false;
+    bool has_frame_ = false;
 
     std::unique_ptr<Impl> impl_;
 
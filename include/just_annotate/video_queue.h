@@ -0,0 +1,60 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <just_annotate/hash_cache.h>
+#include <just_annotate/hash_worker.h>
+#include <just_annotate/video_file.h>
+
+namespace just_annotate {
+
+// Videos to annotate one after the other, from a directory or a list file.  The entries after the
+// current one are prerolled ahead of time, with their first frame uploaded and their hashes in the
+// hash cache, so that moving on to them doesn't wait for the pipeline or for hashing.  Only a few
+// entries are prerolled at once, each with a small frame cache, to bound the memory they hold.
+class VideoQueue {
+  public:
+    using Ptr      = std::shared_ptr<VideoQueue>;
+    using ConstPtr = std::shared_ptr<const VideoQueue>;
+
+    explicit VideoQueue(const HashCache::Ptr& hash_cache);
+    ~VideoQueue() = default;
+
+    // A directory queues the videos in it, sorted by name.  Any other file is read as a list of
+    // paths, one per line and relative to the list's directory, skipping empty lines and lines
+    // starting with '#'.  Returns null if nothing could be queued.
+    static VideoQueue::Ptr open(const std::string& path, const HashCache::Ptr& hash_cache);
+
+    const std::string& getPath() const;
+    size_t size() const;
+    const std::string& getEntry(size_t index) const;
+    // -1 until one of the entries has been opened.
+    int getIndex() const;
+    bool isPrerolled(size_t index) const;
+    // Whether update() still has videos to open or prerolling ones to update.
+    bool isPrerolling() const;
+
+    // Makes the entry with the given path the current one, if it's queued, and hands over its
+    // video if it has been prerolled.  Returns null if the video still needs to be opened.
+    VideoFile::Ptr take(const std::string& path);
+
+    // Prerolls the upcoming entries, from the thread that owns the GL context.  Hashing only starts
+    // while can_hash is set, so that it doesn't compete with hashing the current video.
+    void update(const VideoOptions& options, const std::set<std::string>& algorithms,
+                bool can_hash);
+
+  private:
+    std::string path_;
+    std::vector<std::string> entries_;
+    int index_ = -1;
+    // by entry index, null if the entry failed to open
+    std::map<size_t, VideoFile::Ptr> prerolled_;
+    HashWorker hash_worker_;
+    std::set<std::string> hashed_;
+};
+
+} // namespace just_annotate
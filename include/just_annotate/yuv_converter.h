@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+typedef struct _GstVideoInfo GstVideoInfo;
+
+namespace just_annotate {
+
+// Converts planar YUV frames to RGBA on the GPU.  The planes are uploaded into textures of their
+// own, and a shader pass renders them into an RGBA texture, which saves the CPU colour conversion
+// and uploads 1.5 instead of 4 bytes per pixel for 4:2:0 video.  Needs a current OpenGL 3.0
+// compatibility context, or framebuffer object support.
+class YuvConverter {
+  public:
+    YuvConverter() = default;
+    ~YuvConverter();
+    YuvConverter(const YuvConverter&) = delete;
+    YuvConverter& operator=(const YuvConverter&) = delete;
+
+    static bool isSupported();
+    // NV12 and I420, given as a GstVideoFormat.
+    static bool isSupportedFormat(int format);
+
+    // Allocates plane textures that match the frame layout, to upload the planes into.
+    bool prepare(const GstVideoInfo& info);
+    uint32_t getPlaneTexture(int plane) const;
+    // Renders the uploaded planes into an RGBA texture of the frame's size.
+    bool convert(const GstVideoInfo& info, uint32_t texture_id);
+
+  private:
+    bool createProgram();
+
+    uint32_t program_ = 0;
+    uint32_t framebuffer_ = 0;
+    uint32_t plane_textures_[3] = {};
+    int plane_widths_[3] = {};
+    int plane_heights_[3] = {};
+    int format_ = 0;
+    bool failed_ = false;
+};
+
+} // namespace just_annotate
@@ -1,5 +1,6 @@
 #include <just_annotate/annotation_store.h>
 
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -24,9 +25,16 @@ void to_json(json& j, const Annotations& a) {
 void to_json(json& j, const FileAnnotations& f) {
     j = json{
         {"hash", f.hash},
+        {"hash_algorithm", f.hash_algorithm},
         {"names", f.names},
         {"annotations", f.annotations}
     };
+    if (!f.fingerprint.empty()) {
+        j["fingerprint"] = f.fingerprint;
+    }
+    if (f.size > 0) {
+        j["size"] = f.size;
+    }
 }
 
 void from_json(const json& j, ImVec4& c) {
@@ -49,6 +57,19 @@ void from_json(const json& j, Annotations& a) {
 
 void from_json(const nlohmann::json& j, FileAnnotations& f) {
     j.at("hash").get_to(f.hash);
+    if (j.contains("hash_algorithm")) {
+        j.at("hash_algorithm").get_to(f.hash_algorithm);
+    }
+    else {
+        // projects written before the algorithm was recorded always used sha256
+        f.hash_algorithm = HASH_SHA256;
+    }
+    if (j.contains("fingerprint")) {
+        j.at("fingerprint").get_to(f.fingerprint);
+    }
+    if (j.contains("size")) {
+        j.at("size").get_to(f.size);
+    }
     j.at("names").get_to(f.names);
     j.at("annotations").get_to(f.annotations);
 }
@@ -123,7 +144,11 @@ AnnotationStore::Ptr AnnotationStore::open(const std::string& path) {
                 store->addAnnotationClass(annotation_class);
             }
             for (const auto& file_annotations: files) {
-                store->annotations_[file_annotations.hash] = std::make_shared<FileAnnotations>(file_annotations);
+                auto key = std::make_pair(file_annotations.hash_algorithm, file_annotations.hash);
+                store->annotations_[key] = std::make_shared<FileAnnotations>(file_annotations);
+            }
+            if (j.contains("locations")) {
+                j.at("locations").get_to(store->locations_);
             }
 
             store->is_dirty_ = false;
@@ -156,6 +181,7 @@ bool AnnotationStore::save(const std::string& path) {
     json j;
     j["annotation_classes"] = classes;
     j["files"] = files;
+    j["locations"] = locations_;
 
     std::ofstream outfile(path);
     if (outfile.is_open()) {
@@ -182,27 +208,138 @@ const std::string& AnnotationStore::getPath() const {
   return path_;
 }
 
-void AnnotationStore::setFile(const std::string& name, const std::string& hash) {
-    FileAnnotations::Ptr file_annotations;
+FileAnnotations::Ptr AnnotationStore::findFile(const FileHashes& hashes) const {
+    for (const auto& hash: hashes) {
+        auto annotations_it = annotations_.find(hash);
+        if (annotations_it != annotations_.end()) {
+            return annotations_it->second;
+        }
+    }
+
+    return {};
+}
+
+void AnnotationStore::setFile(const std::string& name, const FileHashes& hashes,
+                              const std::string& preferred_algorithm,
+                              const std::string& fingerprint)
+{
+    FileAnnotations::Ptr file_annotations = findFile(hashes);
+    if (!file_annotations) {
+        auto hash_it = hashes.find(preferred_algorithm);
+        if (hash_it == hashes.end()) {
+            spdlog::error("Missing {} hash for: {}", preferred_algorithm, name);
+            return;
+        }
 
-    auto annotations_it = annotations_.find(hash);
-    if (annotations_it == annotations_.end()) {
         file_annotations = std::make_shared<FileAnnotations>();
-        file_annotations->hash = hash;
-        annotations_[hash] = file_annotations;
-    }
-    else {
-        file_annotations = annotations_it->second;
+        file_annotations->hash = hash_it->second;
+        file_annotations->hash_algorithm = preferred_algorithm;
+        annotations_[*hash_it] = file_annotations;
     }
 
+    if (!fingerprint.empty()) {
+        file_annotations->fingerprint = fingerprint;
+    }
     file_annotations->names.insert(name);
     current_annotations_ = file_annotations;
 }
 
+bool AnnotationStore::setFileByFingerprint(const std::string& fingerprint) {
+    if (fingerprint.empty()) {
+        return false;
+    }
+
+    for (const auto& file: annotations_) {
+        if (file.second->fingerprint == fingerprint) {
+            current_annotations_ = file.second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void AnnotationStore::clearFile() {
+    current_annotations_.reset();
+}
+
 bool AnnotationStore::hasFile() const {
     return current_annotations_ != nullptr;
 }
 
+bool AnnotationStore::matchesFile(const FileHashes& hashes) const {
+    if (!current_annotations_) {
+        return false;
+    }
+
+    auto hash_it = hashes.find(current_annotations_->hash_algorithm);
+    return hash_it != hashes.end() && hash_it->second == current_annotations_->hash;
+}
+
+std::string AnnotationStore::getFileHash() const {
+    if (!current_annotations_) {
+        return {};
+    }
+
+    return current_annotations_->hash;
+}
+
+std::set<std::string> AnnotationStore::getHashAlgorithms() const {
+    std::set<std::string> algorithms;
+    for (const auto& file: annotations_) {
+        algorithms.insert(file.second->hash_algorithm);
+    }
+
+    return algorithms;
+}
+
+void AnnotationStore::setFileLocation(const std::string& path, uint64_t size) {
+    if (!current_annotations_) {
+        return;
+    }
+
+    // locations are only a convenience, so updating them doesn't mark the project as modified
+    current_annotations_->size = size;
+    locations_[current_annotations_->hash] = path;
+}
+
+void AnnotationStore::setFileLocations(const std::map<std::string, std::string>& locations) {
+    for (const auto& location: locations) {
+        locations_[location.first] = location.second;
+    }
+}
+
+std::string AnnotationStore::getFileLocation(const std::string& hash) const {
+    auto location_it = locations_.find(hash);
+    if (location_it == locations_.end()) {
+        return {};
+    }
+
+    return location_it->second;
+}
+
+std::vector<FileAnnotations> AnnotationStore::getFiles() const {
+    std::vector<FileAnnotations> files;
+    for (const auto& file: annotations_) {
+        files.push_back(*file.second);
+    }
+
+    return files;
+}
+
+std::vector<FileAnnotations> AnnotationStore::getMissingFiles() const {
+    std::vector<FileAnnotations> files;
+    for (const auto& file: annotations_) {
+        std::string location = getFileLocation(file.second->hash);
+        std::error_code ec;
+        if (location.empty() || !std::filesystem::exists(location, ec)) {
+            files.push_back(*file.second);
+        }
+    }
+
+    return files;
+}
+
 bool AnnotationStore::setAnnotations(const Annotations& annotations) {
     if (!current_annotations_) {
         spdlog::error("No annotation file selected.");
@@ -36,6 +36,12 @@ void ConfigState::addRecentVideo(const std::string& path) {
     }
 }
 
+void ConfigState::addSearchRoot(const std::string& path) {
+    if (std::find(search_roots.begin(), search_roots.end(), path) == search_roots.end()) {
+        search_roots.push_back(path);
+    }
+}
+
 bool ConfigState::operator==(const ConfigState& other) const {
     return std::equal(recent_files.begin(), recent_files.end(), other.recent_files.begin(), other.recent_files.end())
         && std::equal(recent_videos.begin(), recent_videos.end(), other.recent_videos.begin(), other.recent_videos.end())
@@ -43,7 +49,13 @@ bool ConfigState::operator==(const ConfigState& other) const {
         && window_width == other.window_width
         && window_height == other.window_height
         && window_x == other.window_x
-        && window_y == other.window_y;
+        && window_y == other.window_y
+        && hash_read_strategy == other.hash_read_strategy
+        && hash_algorithm == other.hash_algorithm
+        && search_roots == other.search_roots
+        && frame_cache_mb == other.frame_cache_mb
+        && frame_memory_mb == other.frame_memory_mb
+        && gl_output == other.gl_output;
 }
 
 bool ConfigState::operator!=(const ConfigState& other) const {
@@ -54,7 +66,10 @@ void to_json(json& j, const ConfigState& c) {
     j = json{{"dark_mode", c.dark_mode}, {"window_width", c.window_width},
              {"window_height", c.window_height}, {"window_x", c.window_x},
              {"window_y", c.window_y}, {"recent_files", c.recent_files},
-             {"recent_videos", c.recent_videos}};
+             {"recent_videos", c.recent_videos}, {"hash_read_strategy", c.hash_read_strategy},
+             {"hash_algorithm", c.hash_algorithm}, {"search_roots", c.search_roots},
+             {"frame_cache_mb", c.frame_cache_mb}, {"frame_memory_mb", c.frame_memory_mb},
+             {"gl_output", c.gl_output}};
 }
 
 void from_json(const json& j, ConfigState& c) {
@@ -75,6 +90,30 @@ void from_json(const json& j, ConfigState& c) {
     } else {
         c.recent_videos.clear();
     }
+
+    if (j.contains("hash_read_strategy")) {
+        j.at("hash_read_strategy").get_to(c.hash_read_strategy);
+    }
+
+    if (j.contains("hash_algorithm")) {
+        j.at("hash_algorithm").get_to(c.hash_algorithm);
+    }
+
+    if (j.contains("search_roots")) {
+        j.at("search_roots").get_to(c.search_roots);
+    }
+
+    if (j.contains("frame_cache_mb")) {
+        j.at("frame_cache_mb").get_to(c.frame_cache_mb);
+    }
+
+    if (j.contains("frame_memory_mb")) {
+        j.at("frame_memory_mb").get_to(c.frame_memory_mb);
+    }
+
+    if (j.contains("gl_output")) {
+        j.at("gl_output").get_to(c.gl_output);
+    }
 }
 
 
@@ -90,19 +129,23 @@ std::string expandTilde(const std::string& path) {
     return path;
 }
 
-std::string findConfigPath() {
+std::string findConfigDir() {
     std::string config_dir = expandTilde("~/.config");
     if (!fs::exists(config_dir) || !fs::is_directory(config_dir)) {
         config_dir = expandTilde("~");
         if (!fs::exists(config_dir) || !fs::is_directory(config_dir)) {
             config_dir = "/tmp";
             if (!fs::exists(config_dir) || !fs::is_directory(config_dir)) {
-              return ".just_annotate_config";
+              return ".";
             }
         }
     }
 
-    return config_dir + "/.just_annotate_config";
+    return config_dir;
+}
+
+std::string findConfigPath() {
+    return findConfigDir() + "/.just_annotate_config";
 }
 
 ConfigState getConfig() {
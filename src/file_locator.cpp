@@ -0,0 +1,216 @@
+#include <just_annotate/file_locator.h>
+
+#include <algorithm>
+#include <filesystem>
+
+#include <just_annotate/hash.h>
+#include <just_annotate/ui_wake.h>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+FileLocator::FileLocator(const HashCache::Ptr& hash_cache) : hash_cache_(hash_cache) {
+}
+
+FileLocator::~FileLocator() {
+    cancel();
+}
+
+void FileLocator::start(const std::vector<FileAnnotations>& files,
+                        const std::vector<std::string>& roots, unsigned int num_threads)
+{
+    cancel();
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        locations_.clear();
+    }
+    cancel_ = false;
+    finished_ = false;
+    total_ = 0;
+    completed_ = 0;
+    busy_ = true;
+    thread_ = std::thread(&FileLocator::run, this, files, roots, num_threads);
+}
+
+void FileLocator::cancel() {
+    cancel_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    // a search that finished just before isn't reported either
+    finished_ = false;
+}
+
+bool FileLocator::isBusy() const {
+    return busy_;
+}
+
+size_t FileLocator::getTotal() const {
+    return total_;
+}
+
+size_t FileLocator::getCompleted() const {
+    return completed_;
+}
+
+bool FileLocator::poll(std::map<std::string, std::string>& locations) {
+    if (!finished_.exchange(false)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    locations = locations_;
+    return true;
+}
+
+void FileLocator::run(std::vector<FileAnnotations> files, std::vector<std::string> roots,
+                      unsigned int num_threads)
+{
+    std::map<std::string, std::vector<size_t>> files_by_name;
+    std::map<uint64_t, std::vector<size_t>> files_by_size;
+    for (size_t i = 0; i < files.size(); i++) {
+        for (const auto& name: files[i].names) {
+            files_by_name[name].push_back(i);
+        }
+        if (files[i].size > 0) {
+            files_by_size[files[i].size].push_back(i);
+        }
+    }
+
+    // walking the roots only needs a stat per file, hashing is reserved for plausible candidates
+    std::vector<Candidate> candidates;
+    for (const auto& root: roots) {
+        std::error_code ec;
+        auto options = fs::directory_options::skip_permission_denied;
+        for (auto it = fs::recursive_directory_iterator(root, options, ec);
+             !ec && it != fs::recursive_directory_iterator() && !cancel_; it.increment(ec))
+        {
+            if (!it->is_regular_file(ec)) {
+                continue;
+            }
+
+            uint64_t size = it->file_size(ec);
+            if (ec) {
+                ec.clear();
+                continue;
+            }
+
+            Candidate candidate;
+            candidate.path = it->path().string();
+            auto name_it = files_by_name.find(it->path().filename().string());
+            if (name_it != files_by_name.end()) {
+                for (auto index: name_it->second) {
+                    // a known size that differs rules out a file even if the name matches
+                    if (files[index].size == 0 || files[index].size == size) {
+                        candidate.files.push_back(index);
+                        candidate.name_match = true;
+                    }
+                }
+            }
+            auto size_it = files_by_size.find(size);
+            if (size_it != files_by_size.end()) {
+                for (auto index: size_it->second) {
+                    if (std::find(candidate.files.begin(), candidate.files.end(), index) ==
+                        candidate.files.end())
+                    {
+                        candidate.files.push_back(index);
+                    }
+                }
+            }
+
+            if (!candidate.files.empty()) {
+                candidates.push_back(candidate);
+            }
+        }
+        if (ec) {
+            spdlog::warn("Failed to search {}: {}", root, ec.message());
+        }
+    }
+
+    // renamed copies are only hashed after every file with a matching name has been checked
+    std::stable_partition(candidates.begin(), candidates.end(),
+                          [](const Candidate& candidate) { return candidate.name_match; });
+    total_ = candidates.size();
+    spdlog::info("locating {} files: {} candidates", files.size(), candidates.size());
+
+    std::atomic<size_t> next{0};
+    auto check_candidates = [&]() {
+        while (!cancel_) {
+            size_t i = next++;
+            if (i >= candidates.size()) {
+                break;
+            }
+
+            for (auto index: candidates[i].files) {
+                const auto& file = files[index];
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (locations_.count(file.hash) > 0) {
+                        continue;
+                    }
+                }
+
+                if (matches(candidates[i].path, file)) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    locations_.emplace(file.hash, candidates[i].path);
+                    break;
+                }
+            }
+            completed_++;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < num_threads; i++) {
+        threads.emplace_back(check_candidates);
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    hash_cache_->save();
+
+    if (!cancel_) {
+        finished_ = true;
+    }
+    busy_ = false;
+    just_annotate::wakeUi();
+}
+
+bool FileLocator::matches(const std::string& path, const FileAnnotations& file) {
+    std::string cached = hash_cache_->getHash(path, file.hash_algorithm);
+    if (!cached.empty()) {
+        return cached == file.hash;
+    }
+
+    // the fingerprint rules out most same-sized files after reading only a few megabytes
+    if (!file.fingerprint.empty() && fingerprint(path) != file.fingerprint) {
+        return false;
+    }
+
+    HashCacheEntry before;
+    if (!statFile(path, before)) {
+        return false;
+    }
+
+    // each file is hashed on a single thread, the pool already keeps the cores busy
+    auto progress = [this](uint64_t, uint64_t) { return !cancel_; };
+    std::string hash;
+    if (file.hash_algorithm == HASH_SHA256_TREE) {
+        hash = sha256Tree(path, progress, 1);
+    }
+    else {
+        hash = hashFile(path, file.hash_algorithm, progress);
+    }
+    if (hash.empty()) {
+        return false;
+    }
+
+    hash_cache_->setHash(path, before, hash, file.hash_algorithm);
+    return hash == file.hash;
+}
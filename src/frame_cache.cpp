@@ -0,0 +1,335 @@
+#include <just_annotate/frame_cache.h>
+
+#include <algorithm>
+
+#include <gst/gst.h>
+#include <gst/app/app.h>
+#include <gst/video/video.h>
+#include <spdlog/spdlog.h>
+
+namespace just_annotate {
+
+FrameCache::FrameCache(size_t max_bytes) : max_bytes_(max_bytes) {
+}
+
+FrameCache::~FrameCache() {
+    clear();
+}
+
+void FrameCache::setMaxBytes(size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    evict();
+}
+
+size_t FrameCache::getMaxBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_bytes_;
+}
+
+size_t FrameCache::getBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+size_t FrameCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void FrameCache::insert(int64_t pts, int64_t duration, int width, int height, int format,
+                        GstBuffer* buffer)
+{
+    if (pts < 0 || !buffer) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry_it = entries_.find(pts);
+    if (entry_it != entries_.end()) {
+        bytes_ -= entry_it->second.bytes;
+        gst_buffer_unref(entry_it->second.buffer);
+        lru_.erase(entry_it->second.lru_it);
+        entries_.erase(entry_it);
+    }
+
+    Entry entry;
+    entry.duration = duration;
+    entry.width = width;
+    entry.height = height;
+    entry.format = format;
+    entry.bytes = gst_buffer_get_size(buffer);
+    entry.buffer = gst_buffer_ref(buffer);
+    lru_.push_front(pts);
+    entry.lru_it = lru_.begin();
+    entries_[pts] = entry;
+    bytes_ += entry.bytes;
+
+    evict();
+}
+
+int64_t FrameCache::getStreamTime(GstSample* sample) {
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+        return -1;
+    }
+
+    // buffer timestamps are relative to the segment, which doesn't start at 0 for every container
+    guint64 pts = GST_BUFFER_PTS(buffer);
+    const GstSegment* segment = gst_sample_get_segment(sample);
+    if (segment) {
+        pts = gst_segment_to_stream_time(segment, GST_FORMAT_TIME, pts);
+    }
+    if (pts == GST_CLOCK_TIME_NONE) {
+        return -1;
+    }
+
+    return static_cast<int64_t>(pts);
+}
+
+int64_t FrameCache::insert(GstSample* sample) {
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    GstVideoInfo info;
+    int64_t pts = getStreamTime(sample);
+    if (pts < 0 || !gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+        return -1;
+    }
+
+    int64_t duration = GST_BUFFER_DURATION_IS_VALID(buffer) ?
+        GST_BUFFER_DURATION(buffer) :
+        gst_util_uint64_scale_int(GST_SECOND, info.fps_d, std::max(1, info.fps_n));
+    insert(pts, duration, info.width, info.height, GST_VIDEO_INFO_FORMAT(&info), buffer);
+    return pts;
+}
+
+void FrameCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry: entries_) {
+        gst_buffer_unref(entry.second.buffer);
+    }
+    entries_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+bool FrameCache::find(int64_t time, Frame& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry_it = entries_.upper_bound(time);
+    if (entry_it == entries_.begin()) {
+        return false;
+    }
+
+    entry_it--;
+    if (time >= entry_it->first + entry_it->second.duration) {
+        return false;
+    }
+
+    return get(entry_it, frame);
+}
+
+bool FrameCache::next(int64_t pts, Frame& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry_it = entries_.upper_bound(pts);
+    if (entry_it == entries_.end()) {
+        return false;
+    }
+
+    // allow for timestamps that are rounded to a coarser clock than the frame duration
+    int64_t duration = entry_it->second.duration;
+    if (entry_it->first > pts + duration + duration / 2) {
+        return false;
+    }
+
+    return get(entry_it, frame);
+}
+
+bool FrameCache::previous(int64_t pts, Frame& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry_it = entries_.lower_bound(pts);
+    if (entry_it == entries_.begin()) {
+        return false;
+    }
+
+    entry_it--;
+    int64_t duration = entry_it->second.duration;
+    if (entry_it->first + duration + duration / 2 < pts) {
+        return false;
+    }
+
+    return get(entry_it, frame);
+}
+
+int64_t FrameCache::contiguousStart(int64_t pts) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry_it = entries_.find(pts);
+    if (entry_it == entries_.end()) {
+        return -1;
+    }
+
+    while (entry_it != entries_.begin()) {
+        auto previous_it = std::prev(entry_it);
+        int64_t duration = previous_it->second.duration;
+        if (previous_it->first + duration + duration / 2 < entry_it->first) {
+            break;
+        }
+        entry_it = previous_it;
+    }
+
+    return entry_it->first;
+}
+
+bool FrameCache::get(std::map<int64_t, Entry>::iterator it, Frame& frame) {
+    lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+
+    frame.pts = it->first;
+    frame.duration = it->second.duration;
+    frame.width = it->second.width;
+    frame.height = it->second.height;
+    frame.format = it->second.format;
+    frame.buffer = gst_buffer_ref(it->second.buffer);
+    return true;
+}
+
+void FrameCache::evict() {
+    while (bytes_ > max_bytes_ && !lru_.empty()) {
+        auto entry_it = entries_.find(lru_.back());
+        bytes_ -= entry_it->second.bytes;
+        gst_buffer_unref(entry_it->second.buffer);
+        entries_.erase(entry_it);
+        lru_.pop_back();
+    }
+}
+
+FramePrefetcher::FramePrefetcher(const std::string& uri, const std::string& caps,
+                                 const FrameCache::Ptr& frame_cache)
+  : uri_(uri), caps_(caps), frame_cache_(frame_cache)
+{
+    thread_ = std::thread(&FramePrefetcher::run, this);
+}
+
+FramePrefetcher::~FramePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+        abort_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+
+    if (pipeline_) {
+        gst_element_set_state(pipeline_, GST_STATE_NULL);
+        gst_object_unref(framesink_);
+        gst_object_unref(pipeline_);
+    }
+}
+
+void FramePrefetcher::request(int64_t start, int64_t end, bool from_keyframe) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        start_ = std::max<int64_t>(0, start);
+        end_ = end;
+        from_keyframe_ = from_keyframe;
+        pending_ = true;
+        abort_ = true;
+        busy_ = true;
+    }
+    condition_.notify_all();
+}
+
+void FramePrefetcher::cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ = false;
+    abort_ = true;
+}
+
+bool FramePrefetcher::isBusy() const {
+    return busy_;
+}
+
+bool FramePrefetcher::createPipeline() {
+    // same conversion as the playback pipeline, but as fast as the decoder allows
+    std::string config = "uridecodebin uri=" + uri_;
+    config += " ! videoscale ! videoconvert ! " + caps_ + " ! appsink name=framesink sync=0";
+    config += " max-buffers=4";
+
+    GError* error = nullptr;
+    pipeline_ = gst_parse_launch(config.c_str(), &error);
+    if (!pipeline_) {
+        spdlog::error("Failed to create prefetch pipeline: {}", error ? error->message : "unknown");
+        g_clear_error(&error);
+        return false;
+    }
+    g_clear_error(&error);
+    framesink_ = gst_bin_get_by_name(GST_BIN(pipeline_), "framesink");
+
+    // nothing watches this bus, so don't let messages pile up on it
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline_));
+    gst_bus_set_flushing(bus, TRUE);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline_, GST_STATE_PAUSED);
+    if (gst_element_get_state(pipeline_, nullptr, nullptr, 10 * GST_SECOND) ==
+        GST_STATE_CHANGE_FAILURE)
+    {
+        spdlog::error("Failed to preroll prefetch pipeline for: {}", uri_);
+        return false;
+    }
+
+    return true;
+}
+
+void FramePrefetcher::run() {
+    bool pipeline_ok = true;
+    while (true) {
+        int64_t start = 0;
+        int64_t end = 0;
+        bool from_keyframe = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            busy_ = pending_;
+            condition_.wait(lock, [this]() { return pending_ || exit_; });
+            if (exit_) {
+                break;
+            }
+            start = start_;
+            end = end_;
+            from_keyframe = from_keyframe_;
+            pending_ = false;
+            abort_ = false;
+        }
+
+        if (!pipeline_ && pipeline_ok) {
+            pipeline_ok = createPipeline();
+        }
+        if (!pipeline_ok) {
+            continue;
+        }
+
+        // the stop position makes the pipeline end of stream after the last frame of the window
+        auto flags = from_keyframe ? GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE
+                                   : GST_SEEK_FLAG_ACCURATE;
+        if (!gst_element_seek(pipeline_, 1.0, GST_FORMAT_TIME,
+                              GstSeekFlags(GST_SEEK_FLAG_FLUSH | flags),
+                              GST_SEEK_TYPE_SET, start, GST_SEEK_TYPE_SET, end))
+        {
+            spdlog::warn("Failed to seek prefetch pipeline.");
+            continue;
+        }
+        gst_element_set_state(pipeline_, GST_STATE_PLAYING);
+
+        while (!abort_ && !gst_app_sink_is_eos(GST_APP_SINK(framesink_))) {
+            GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(framesink_),
+                                                             100 * GST_MSECOND);
+            if (!sample) {
+                continue;
+            }
+
+            frame_cache_->insert(sample);
+            gst_sample_unref(sample);
+        }
+
+        gst_element_set_state(pipeline_, GST_STATE_PAUSED);
+    }
+}
+
+} // namespace just_annotate
@@ -0,0 +1,59 @@
+#include <just_annotate/frame_ring.h>
+
+#include <gst/gst.h>
+
+namespace just_annotate {
+
+FrameRing::FrameRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size *= 2;
+    }
+    slots_.resize(size);
+    mask_ = size - 1;
+}
+
+FrameRing::~FrameRing() {
+    clear();
+}
+
+bool FrameRing::push(const Frame& frame) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) > mask_) {
+        return false;
+    }
+
+    // the slot is published to the popping thread by the release store of the new head
+    slots_[head & mask_] = frame;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameRing::pop(Frame& frame) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    frame = slots_[tail & mask_];
+    slots_[tail & mask_] = {};
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void FrameRing::clear() {
+    Frame frame;
+    while (pop(frame)) {
+        gst_buffer_unref(frame.buffer);
+    }
+}
+
+size_t FrameRing::getDropped() const {
+    return dropped_;
+}
+
+void FrameRing::countDropped() {
+    dropped_++;
+}
+
+} // namespace just_annotate
@@ -1,70 +1,524 @@
 #include <just_annotate/hash.h>
 
-#include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
-#include <sstream>
 #include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
 
-#include <openssl/md5.h>
-#include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <spdlog/spdlog.h>
 
-std::string sha256(const std::string& path) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+#ifndef FUSE_SUPER_MAGIC
+#define FUSE_SUPER_MAGIC 0x65735546
+#endif
+#ifndef CIFS_SUPER_MAGIC
+#define CIFS_SUPER_MAGIC 0xFF534D42
+#endif
+#ifndef SMB2_SUPER_MAGIC
+#define SMB2_SUPER_MAGIC 0xFE534D42
+#endif
+
+// size of each mmap window or pread call, large enough to keep NVMe queues busy
+const size_t READ_BLOCK_SIZE    = 8 << 20;
+const size_t READ_ALIGNMENT     = 4096;
+const size_t STREAM_BUFFER_SIZE = 32768;
+
+struct FileDescriptor {
+    int fd = -1;
+
+    explicit FileDescriptor(const std::string& path) : fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+    }
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+struct DigestContext {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+
+    ~DigestContext() {
+        EVP_MD_CTX_free(ctx);
+    }
+};
+
+std::string toHex(const unsigned char* data, unsigned int length) {
+    std::stringstream ss;
+    for (unsigned int i = 0; i < length; ++i) {
+        ss << std::hex << std::setw(2) << std::setfill('0') << (int)data[i];
+    }
+    return ss.str();
+}
+
+std::string toString(HashReadStrategy strategy) {
+    switch (strategy) {
+        case HashReadStrategy::STREAM:
+            return "stream";
+        case HashReadStrategy::MMAP:
+            return "mmap";
+        case HashReadStrategy::PREAD:
+            return "pread";
+        case HashReadStrategy::AUTO:
+        default:
+            return "auto";
+    }
+}
+
+HashReadStrategy hashReadStrategyFromString(const std::string& name) {
+    if (name == "stream") {
+        return HashReadStrategy::STREAM;
+    }
+    if (name == "mmap") {
+        return HashReadStrategy::MMAP;
+    }
+    if (name == "pread") {
+        return HashReadStrategy::PREAD;
+    }
+    return HashReadStrategy::AUTO;
+}
+
+HashReadStrategy resolveStrategy(int fd, HashReadStrategy strategy) {
+    if (strategy != HashReadStrategy::AUTO) {
+        return strategy;
+    }
+
+    struct statfs fs_info;
+    if (fstatfs(fd, &fs_info) != 0) {
+        return HashReadStrategy::PREAD;
+    }
 
+    switch (static_cast<uint32_t>(fs_info.f_type)) {
+        case NFS_SUPER_MAGIC:
+        case FUSE_SUPER_MAGIC:
+        case CIFS_SUPER_MAGIC:
+        case SMB2_SUPER_MAGIC:
+        case SMB_SUPER_MAGIC:
+            return HashReadStrategy::PREAD;
+        default:
+            return HashReadStrategy::MMAP;
+    }
+}
+
+bool digestStream(const std::string& path, EVP_MD_CTX* ctx, uint64_t total_bytes,
+                  const HashProgressCallback& progress)
+{
     std::ifstream file(path, std::ifstream::binary);
     if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<char> buffer(STREAM_BUFFER_SIZE);
+    uint64_t bytes_read = 0;
+    while (file.good()) {
+        file.read(buffer.data(), buffer.size());
+        EVP_DigestUpdate(ctx, buffer.data(), file.gcount());
+        bytes_read += file.gcount();
+
+        if (progress && !progress(bytes_read, total_bytes)) {
+            return false;
+        }
+    }
+
+    return !file.bad();
+}
+
+bool digestMmap(int fd, EVP_MD_CTX* ctx, uint64_t total_bytes, const HashProgressCallback& progress) {
+    if (total_bytes == 0) {
+        return true;
+    }
+
+    void* mapped = mmap(nullptr, total_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    madvise(mapped, total_bytes, MADV_SEQUENTIAL);
+
+    const unsigned char* data = static_cast<const unsigned char*>(mapped);
+    bool completed = true;
+    for (uint64_t offset = 0; offset < total_bytes; offset += READ_BLOCK_SIZE) {
+        uint64_t length = std::min<uint64_t>(READ_BLOCK_SIZE, total_bytes - offset);
+
+        // ask for the next window while this one is hashed
+        if (offset + length < total_bytes) {
+            uint64_t next_length = std::min<uint64_t>(READ_BLOCK_SIZE, total_bytes - offset - length);
+            madvise(const_cast<unsigned char*>(data) + offset + length, next_length, MADV_WILLNEED);
+        }
+
+        EVP_DigestUpdate(ctx, data + offset, length);
+
+        // drop hashed pages so multi-GB files don't push everything else out of memory
+        madvise(const_cast<unsigned char*>(data) + offset, length, MADV_DONTNEED);
+
+        if (progress && !progress(offset + length, total_bytes)) {
+            completed = false;
+            break;
+        }
+    }
+
+    munmap(mapped, total_bytes);
+    return completed;
+}
+
+bool digestPread(int fd, EVP_MD_CTX* ctx, uint64_t total_bytes, const HashProgressCallback& progress) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    void* aligned = nullptr;
+    if (posix_memalign(&aligned, READ_ALIGNMENT, READ_BLOCK_SIZE) != 0) {
+        return false;
+    }
+    std::unique_ptr<void, decltype(&free)> buffer(aligned, &free);
+
+    uint64_t offset = 0;
+    while (true) {
+        readahead(fd, offset + READ_BLOCK_SIZE, READ_BLOCK_SIZE);
+
+        ssize_t length = pread(fd, buffer.get(), READ_BLOCK_SIZE, offset);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (length == 0) {
+            break;
+        }
+
+        EVP_DigestUpdate(ctx, buffer.get(), length);
+        offset += length;
+
+        if (progress && !progress(offset, total_bytes)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string digestFile(const std::string& path, const EVP_MD* md,
+                       const HashProgressCallback& progress, HashReadStrategy strategy)
+{
+    FileDescriptor file(path);
+    if (file.fd < 0) {
         spdlog::error("Failed to open file: {}", path);
         return {};
     }
 
-    const size_t buffer_size = 32768;
-    char* buffer = new char[buffer_size];
-    while (file.good()) {
-        file.read(buffer, buffer_size);
-        SHA256_Update(&sha256, buffer, file.gcount());
+    struct stat st;
+    if (fstat(file.fd, &st) != 0) {
+        spdlog::error("Failed to stat file: {}", path);
+        return {};
     }
-    delete[] buffer;
-    file.close();
+    uint64_t total_bytes = st.st_size;
 
-    SHA256_Final(hash, &sha256);
+    DigestContext digest;
+    if (!digest.ctx || !EVP_DigestInit_ex(digest.ctx, md, nullptr)) {
+        spdlog::error("Failed to initialize digest.");
+        return {};
+    }
 
-    std::stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
+    bool completed = false;
+    switch (resolveStrategy(file.fd, strategy)) {
+        case HashReadStrategy::STREAM:
+            completed = digestStream(path, digest.ctx, total_bytes, progress);
+            break;
+        case HashReadStrategy::MMAP:
+            completed = digestMmap(file.fd, digest.ctx, total_bytes, progress);
+            break;
+        case HashReadStrategy::PREAD:
+        default:
+            completed = digestPread(file.fd, digest.ctx, total_bytes, progress);
+            break;
     }
 
-    return ss.str();
+    if (!completed) {
+        return {};
+    }
+
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hash_length = 0;
+    if (!EVP_DigestFinal_ex(digest.ctx, hash, &hash_length)) {
+        spdlog::error("Failed to finalize digest.");
+        return {};
+    }
+
+    return toHex(hash, hash_length);
 }
 
-std::string md5sum(const std::string& path) {
-    unsigned char hash[MD5_DIGEST_LENGTH];
-    MD5_CTX md5;
-    MD5_Init(&md5);
+std::string sha256(const std::string& path, const HashProgressCallback& progress,
+                   HashReadStrategy strategy)
+{
+    return digestFile(path, EVP_sha256(), progress, strategy);
+}
 
-    std::ifstream file(path, std::ifstream::binary);
-    if (!file.is_open()) {
+typedef std::array<unsigned char, 32> TreeNode;
+
+const unsigned char TREE_LEAF_FLAG   = 0x00;
+const unsigned char TREE_PARENT_FLAG = 0x01;
+const unsigned char TREE_ROOT_FLAG   = 0x02;
+
+// number of consecutive chunks a thread claims at once, so each thread still reads sequentially
+const uint64_t TREE_CHUNKS_PER_TASK = 16;
+
+void encodeLittleEndian(uint64_t value, unsigned char* bytes) {
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+TreeNode hashTreeNode(EVP_MD_CTX* ctx, unsigned char flag, const void* prefix, size_t prefix_length,
+                      const void* data, size_t length)
+{
+    TreeNode node;
+    unsigned int node_length = 0;
+    EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+    EVP_DigestUpdate(ctx, &flag, 1);
+    EVP_DigestUpdate(ctx, prefix, prefix_length);
+    EVP_DigestUpdate(ctx, data, length);
+    EVP_DigestFinal_ex(ctx, node.data(), &node_length);
+    return node;
+}
+
+// Merges leaves the way BLAKE3 does: the left subtree always holds the largest power of two number
+// of chunks, so the shape of the tree only depends on the file size.
+TreeNode mergeTree(EVP_MD_CTX* ctx, const std::vector<TreeNode>& leaves, size_t begin, size_t end) {
+    size_t count = end - begin;
+    if (count == 1) {
+        return leaves[begin];
+    }
+
+    size_t left_count = 1;
+    while (left_count * 2 < count) {
+        left_count *= 2;
+    }
+
+    TreeNode left = mergeTree(ctx, leaves, begin, begin + left_count);
+    TreeNode right = mergeTree(ctx, leaves, begin + left_count, end);
+    return hashTreeNode(ctx, TREE_PARENT_FLAG, left.data(), left.size(), right.data(), right.size());
+}
+
+std::string sha256Tree(const std::string& path, const HashProgressCallback& progress,
+                       unsigned int num_threads)
+{
+    FileDescriptor file(path);
+    if (file.fd < 0) {
         spdlog::error("Failed to open file: {}", path);
         return {};
     }
 
-    const size_t buffer_size = 32768;
-    char* buffer = new char[buffer_size];
-    while (file.good()) {
-        file.read(buffer, buffer_size);
-        MD5_Update(&md5, buffer, file.gcount());
+    struct stat st;
+    if (fstat(file.fd, &st) != 0) {
+        spdlog::error("Failed to stat file: {}", path);
+        return {};
     }
-    delete[] buffer;
-    file.close();
+    uint64_t total_bytes = st.st_size;
 
-    MD5_Final(hash, &md5);
+    uint64_t num_chunks = std::max<uint64_t>(1, (total_bytes + TREE_CHUNK_SIZE - 1) / TREE_CHUNK_SIZE);
+    std::vector<TreeNode> leaves(num_chunks);
 
-    std::stringstream ss;
-    for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
     }
+    uint64_t num_tasks = (num_chunks + TREE_CHUNKS_PER_TASK - 1) / TREE_CHUNKS_PER_TASK;
+    num_threads = std::min<uint64_t>(num_threads, num_tasks);
 
-    return ss.str();
+    std::atomic<uint64_t> next_chunk{0};
+    std::atomic<uint64_t> bytes_read{0};
+    std::atomic<bool> stop{false};
+    std::atomic<bool> failed{false};
+    std::mutex mutex;
+    std::condition_variable finished;
+    unsigned int running = num_threads;
+
+    auto hash_chunks = [&]() {
+        DigestContext digest;
+        void* aligned = nullptr;
+        if (!digest.ctx || posix_memalign(&aligned, READ_ALIGNMENT, TREE_CHUNK_SIZE) != 0) {
+            failed = true;
+        }
+        std::unique_ptr<void, decltype(&free)> buffer(aligned, &free);
+
+        while (!stop && !failed) {
+            uint64_t first = next_chunk.fetch_add(TREE_CHUNKS_PER_TASK);
+            if (first >= num_chunks) {
+                break;
+            }
+            uint64_t last = std::min(first + TREE_CHUNKS_PER_TASK, num_chunks);
+            readahead(file.fd, first * TREE_CHUNK_SIZE, (last - first) * TREE_CHUNK_SIZE);
+
+            for (uint64_t chunk = first; chunk < last && !stop; chunk++) {
+                uint64_t offset = chunk * TREE_CHUNK_SIZE;
+                size_t wanted = std::min<uint64_t>(TREE_CHUNK_SIZE, total_bytes - offset);
+                size_t filled = 0;
+                while (filled < wanted) {
+                    ssize_t length = pread(file.fd, static_cast<char*>(buffer.get()) + filled,
+                                           wanted - filled, offset + filled);
+                    if (length < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (length <= 0) {
+                        failed = true;
+                        break;
+                    }
+                    filled += length;
+                }
+                if (failed) {
+                    break;
+                }
+
+                // the chunk index is part of the leaf so identical chunks at different offsets differ
+                unsigned char index[8];
+                encodeLittleEndian(chunk, index);
+                leaves[chunk] = hashTreeNode(digest.ctx, TREE_LEAF_FLAG, index, sizeof(index),
+                                             buffer.get(), filled);
+                bytes_read += filled;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        running--;
+        finished.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < num_threads; i++) {
+        threads.emplace_back(hash_chunks);
+    }
+
+    // progress is reported from the calling thread so the callback never runs concurrently
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running > 0) {
+            finished.wait_for(lock, std::chrono::milliseconds(50));
+            if (progress && !stop) {
+                lock.unlock();
+                if (!progress(bytes_read, total_bytes)) {
+                    stop = true;
+                }
+                lock.lock();
+            }
+        }
+    }
+
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    if (failed) {
+        spdlog::error("Failed to read file: {}", path);
+        return {};
+    }
+    if (stop) {
+        return {};
+    }
+
+    DigestContext digest;
+    TreeNode root = mergeTree(digest.ctx, leaves, 0, leaves.size());
+
+    unsigned char size_bytes[8];
+    encodeLittleEndian(total_bytes, size_bytes);
+    TreeNode hash = hashTreeNode(digest.ctx, TREE_ROOT_FLAG, size_bytes, sizeof(size_bytes),
+                                 root.data(), root.size());
+
+    return toHex(hash.data(), hash.size());
+}
+
+std::string hashFile(const std::string& path, const std::string& algorithm,
+                     const HashProgressCallback& progress, HashReadStrategy strategy)
+{
+    if (algorithm == HASH_SHA256) {
+        return sha256(path, progress, strategy);
+    }
+    if (algorithm == HASH_SHA256_TREE) {
+        return sha256Tree(path, progress);
+    }
+
+    spdlog::error("Unknown hash algorithm: {}", algorithm);
+    return {};
+}
+
+std::string fingerprint(const std::string& path) {
+    FileDescriptor file(path);
+    if (file.fd < 0) {
+        spdlog::error("Failed to open file: {}", path);
+        return {};
+    }
+
+    struct stat st;
+    if (fstat(file.fd, &st) != 0) {
+        spdlog::error("Failed to stat file: {}", path);
+        return {};
+    }
+    uint64_t file_size = st.st_size;
+
+    DigestContext digest;
+    if (!digest.ctx || !EVP_DigestInit_ex(digest.ctx, EVP_sha256(), nullptr)) {
+        spdlog::error("Failed to initialize digest.");
+        return {};
+    }
+
+    // the size is hashed as fixed width little-endian so the result doesn't depend on the host
+    unsigned char size_bytes[8];
+    encodeLittleEndian(file_size, size_bytes);
+    EVP_DigestUpdate(digest.ctx, size_bytes, sizeof(size_bytes));
+
+    // small files are hashed completely, otherwise sample the head, middle and tail
+    std::vector<uint64_t> offsets;
+    if (file_size <= 3 * FINGERPRINT_CHUNK_SIZE) {
+        for (uint64_t offset = 0; offset < file_size; offset += FINGERPRINT_CHUNK_SIZE) {
+            offsets.push_back(offset);
+        }
+    }
+    else {
+        offsets = {0, (file_size - FINGERPRINT_CHUNK_SIZE) / 2, file_size - FINGERPRINT_CHUNK_SIZE};
+    }
+
+    std::vector<unsigned char> buffer(FINGERPRINT_CHUNK_SIZE);
+    for (auto offset: offsets) {
+        size_t filled = 0;
+        size_t wanted = std::min<uint64_t>(FINGERPRINT_CHUNK_SIZE, file_size - offset);
+        while (filled < wanted) {
+            ssize_t length = pread(file.fd, buffer.data() + filled, wanted - filled, offset + filled);
+            if (length < 0 && errno == EINTR) {
+                continue;
+            }
+            if (length <= 0) {
+                spdlog::error("Failed to read file: {}", path);
+                return {};
+            }
+            filled += length;
+        }
+        EVP_DigestUpdate(digest.ctx, buffer.data(), filled);
+    }
+
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hash_length = 0;
+    if (!EVP_DigestFinal_ex(digest.ctx, hash, &hash_length)) {
+        spdlog::error("Failed to finalize digest.");
+        return {};
+    }
+
+    return toHex(hash, hash_length);
+}
+
+std::string md5sum(const std::string& path, HashReadStrategy strategy) {
+    return digestFile(path, EVP_md5(), {}, strategy);
 }
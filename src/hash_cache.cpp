@@ -0,0 +1,226 @@
+#include <just_annotate/hash_cache.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+
+#include <sys/stat.h>
+
+#include <just_annotate/config_store.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+void to_json(json& j, const HashCacheEntry& e) {
+    j = json{{"path", e.path}, {"size", e.size}, {"mtime", e.mtime}, {"inode", e.inode},
+             {"hashes", e.hashes}};
+}
+
+void from_json(const json& j, HashCacheEntry& e) {
+    j.at("path").get_to(e.path);
+    j.at("size").get_to(e.size);
+    j.at("mtime").get_to(e.mtime);
+    j.at("inode").get_to(e.inode);
+    if (j.contains("hashes")) {
+        j.at("hashes").get_to(e.hashes);
+    }
+    else {
+        // caches written before the tree hash only held a sha256
+        j.at("hash").get_to(e.hashes[HASH_SHA256]);
+    }
+}
+
+std::string normalizePath(const std::string& path) {
+    std::error_code ec;
+    auto normalized = fs::weakly_canonical(path, ec);
+    if (ec) {
+        return fs::absolute(path).lexically_normal().string();
+    }
+    return normalized.string();
+}
+
+bool statFile(const std::string& path, HashCacheEntry& entry) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+
+    entry.size = static_cast<uint64_t>(st.st_size);
+    entry.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    entry.inode = static_cast<uint64_t>(st.st_ino);
+    return true;
+}
+
+bool HashCacheEntry::isStale() const {
+    HashCacheEntry current;
+    if (!statFile(path, current)) {
+        return true;
+    }
+
+    return current.size != size || current.mtime != mtime || current.inode != inode;
+}
+
+HashCache::Ptr HashCache::open() {
+    return open(findConfigDir() + "/.just_annotate_hash_cache");
+}
+
+HashCache::Ptr HashCache::open(const std::string& path) {
+    auto cache = std::make_shared<HashCache>();
+    cache->path_ = path;
+
+    if (!fs::exists(path)) {
+        return cache;
+    }
+
+    std::ifstream infile(path);
+    if (infile.is_open()) {
+        try {
+            json j;
+            infile >> j;
+            infile.close();
+
+            std::vector<HashCacheEntry> entries;
+            j.at("entries").get_to(entries);
+            for (const auto& entry: entries) {
+                cache->entries_[entry.path] = entry;
+            }
+        }
+        catch (json::exception& e) {
+            spdlog::warn("Discarding unreadable hash cache {}: {}", path, e.what());
+        }
+        return cache;
+    }
+
+    spdlog::warn("Failed to open file: {}", path);
+    return cache;
+}
+
+bool HashCache::save() {
+    std::lock_guard<std::mutex> save_lock(save_mutex_);
+
+    std::vector<HashCacheEntry> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry: entries_) {
+            entries.push_back(entry.second);
+        }
+    }
+
+    json j;
+    j["entries"] = entries;
+
+    // write to a temporary file first so that a crash never leaves a truncated cache behind
+    std::string tmp_path = path_ + ".tmp";
+    std::ofstream outfile(tmp_path);
+    if (outfile.is_open()) {
+        outfile << std::setw(4) << j << std::endl;
+        outfile.close();
+
+        std::error_code ec;
+        fs::rename(tmp_path, path_, ec);
+        if (!ec) {
+            return true;
+        }
+    }
+
+    spdlog::error("Failed to save hash cache to: {}", path_);
+    return false;
+}
+
+const std::string& HashCache::getPath() const {
+    return path_;
+}
+
+std::string HashCache::getHash(const std::string& path, const std::string& algorithm) const {
+    HashCacheEntry current;
+    if (!statFile(path, current)) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry_it = entries_.find(normalizePath(path));
+    if (entry_it == entries_.end()) {
+        return {};
+    }
+
+    const auto& entry = entry_it->second;
+    if (entry.size != current.size || entry.mtime != current.mtime || entry.inode != current.inode) {
+        return {};
+    }
+
+    auto hash_it = entry.hashes.find(algorithm);
+    if (hash_it == entry.hashes.end()) {
+        return {};
+    }
+
+    return hash_it->second;
+}
+
+bool HashCache::setHash(const std::string& path, const HashCacheEntry& before,
+                        const std::string& hash, const std::string& algorithm)
+{
+    // a file that was written to while it was hashed would otherwise be cached with a wrong hash
+    HashCacheEntry current;
+    if (!statFile(path, current)) {
+        return false;
+    }
+    if (current.size != before.size || current.mtime != before.mtime ||
+        current.inode != before.inode)
+    {
+        spdlog::warn("{} changed while it was hashed, not caching its {}", path, algorithm);
+        return false;
+    }
+    current.path = normalizePath(path);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = entries_[current.path];
+
+    // hashes of other algorithms are only kept if they belong to the same version of the file
+    if (entry.size != current.size || entry.mtime != current.mtime || entry.inode != current.inode) {
+        entry = current;
+    }
+    entry.hashes[algorithm] = hash;
+    return true;
+}
+
+std::vector<HashCacheEntry> HashCache::getEntries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<HashCacheEntry> entries;
+    for (const auto& entry: entries_) {
+        entries.push_back(entry.second);
+    }
+    return entries;
+}
+
+size_t HashCache::prune() {
+    // stat without holding the lock, a slow or unreachable drive would block every lookup
+    std::vector<HashCacheEntry> stale;
+    for (const auto& entry: getEntries()) {
+        if (entry.isStale()) {
+            stale.push_back(entry);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t pruned = 0;
+    for (const auto& entry: stale) {
+        auto entry_it = entries_.find(entry.path);
+        if (entry_it == entries_.end()) {
+            continue;
+        }
+
+        // the entry was replaced by a fresh hash in the meantime
+        const auto& current = entry_it->second;
+        if (current.size != entry.size || current.mtime != entry.mtime ||
+            current.inode != entry.inode)
+        {
+            continue;
+        }
+
+        entries_.erase(entry_it);
+        pruned++;
+    }
+    return pruned;
+}
@@ -0,0 +1,109 @@
+#include <just_annotate/hash_cache_dialog.h>
+
+#include <algorithm>
+
+#include <imgui.h>
+#include <spdlog/spdlog.h>
+
+void HashCacheDialog::SetTitle(const std::string& title) {
+    title_ = title;
+}
+
+void HashCacheDialog::Open(const HashCache::Ptr& cache) {
+    cache_ = cache;
+    has_pruned_ = false;
+    Refresh();
+
+    ImGui::OpenPopup(title_.c_str());
+}
+
+void HashCacheDialog::Refresh() {
+    entries_.clear();
+    stale_.clear();
+    if (!cache_) {
+        return;
+    }
+
+    entries_ = cache_->getEntries();
+    for (const auto& entry: entries_) {
+        stale_.push_back(entry.isStale());
+    }
+}
+
+void HashCacheDialog::Display() {
+    ImGui::SetNextWindowSize(ImVec2(720, 400), ImGuiCond_Appearing);
+    if (ImGui::BeginPopupModal(title_.c_str(), nullptr)) {
+        size_t stale_count = std::count(stale_.begin(), stale_.end(), true);
+        ImGui::Text("%zu entries, %zu stale", entries_.size(), stale_count);
+        if (cache_) {
+            ImGui::TextDisabled("%s", cache_->getPath().c_str());
+        }
+
+        ImVec2 table_size(0.0f, ImGui::GetContentRegionAvail().y - ImGui::GetFrameHeightWithSpacing() * 1.5f);
+        ImGuiTableFlags table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                                      ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+        if (ImGui::BeginTable("hash-cache-table", 4, table_flags, table_size)) {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Path", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("Size (MB)", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn("Hashes", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn("Status", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableHeadersRow();
+
+            for (size_t i = 0; i < entries_.size(); i++) {
+                const auto& entry = entries_[i];
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(entry.path.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", entry.size / 1e6);
+                ImGui::TableNextColumn();
+                std::string algorithms;
+                std::string tooltip;
+                for (const auto& hash: entry.hashes) {
+                    algorithms += (algorithms.empty() ? "" : ", ") + hash.first;
+                    tooltip += hash.first + ": " + hash.second + "\n";
+                }
+                ImGui::TextUnformatted(algorithms.c_str());
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("%s", tooltip.c_str());
+                }
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(stale_[i] ? "stale" : "ok");
+            }
+
+            ImGui::EndTable();
+        }
+
+        ImGui::BeginDisabled(stale_count == 0);
+        if (ImGui::Button("Prune Stale")) {
+            last_pruned_ = cache_->prune();
+            has_pruned_ = true;
+            if (!cache_->save()) {
+                spdlog::error("Failed to save pruned hash cache.");
+            }
+            Refresh();
+        }
+        ImGui::EndDisabled();
+
+        ImGui::SameLine();
+        if (ImGui::Button("Refresh")) {
+            Refresh();
+        }
+
+        ImGui::SameLine();
+        if (ImGui::Button("Close")) {
+            cache_.reset();
+            entries_.clear();
+            stale_.clear();
+            ImGui::CloseCurrentPopup();
+        }
+
+        if (has_pruned_) {
+            ImGui::SameLine();
+            ImGui::Text("Pruned %zu entries.", last_pruned_);
+        }
+
+        ImGui::EndPopup();
+    }
+}
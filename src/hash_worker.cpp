@@ -0,0 +1,129 @@
+#include <just_annotate/hash_worker.h>
+
+#include <chrono>
+
+#include <just_annotate/hash.h>
+#include <just_annotate/ui_wake.h>
+#include <spdlog/spdlog.h>
+
+HashWorker::HashWorker(const HashCache::Ptr& hash_cache) : hash_cache_(hash_cache) {
+}
+
+HashWorker::~HashWorker() {
+    cancel();
+}
+
+void HashWorker::setReadStrategy(HashReadStrategy strategy) {
+    read_strategy_ = strategy;
+}
+
+void HashWorker::start(const std::string& path, const std::set<std::string>& algorithms) {
+    cancel();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = std::make_shared<Job>();
+    job_->path = path;
+    job_->algorithms = algorithms;
+    reported_ = false;
+    thread_ = std::thread(&HashWorker::run, this, job_);
+}
+
+void HashWorker::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (job_) {
+            job_->cancel = true;
+        }
+    }
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool HashWorker::isBusy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return job_ && !job_->done;
+}
+
+std::string HashWorker::getPath() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!job_) {
+        return {};
+    }
+    return job_->path;
+}
+
+std::set<std::string> HashWorker::getAlgorithms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!job_) {
+        return {};
+    }
+    return job_->algorithms;
+}
+
+float HashWorker::getProgress() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!job_) {
+        return 0.0f;
+    }
+    return job_->progress;
+}
+
+bool HashWorker::poll(Result& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!job_ || !job_->done || reported_) {
+        return false;
+    }
+
+    reported_ = true;
+    result = job_->result;
+    return true;
+}
+
+void HashWorker::run(std::shared_ptr<Job> job) {
+    FileHashes hashes;
+    size_t completed = 0;
+    for (const auto& algorithm: job->algorithms) {
+        std::string hash = hash_cache_->getHash(job->path, algorithm);
+        if (hash.empty()) {
+            HashCacheEntry before;
+            bool has_stat = statFile(job->path, before);
+
+            auto start_time = std::chrono::steady_clock::now();
+            float num_algorithms = job->algorithms.size();
+            hash = hashFile(job->path, algorithm, [&](uint64_t bytes_read, uint64_t total_bytes) {
+                if (total_bytes > 0) {
+                    float fraction = static_cast<float>(bytes_read) / total_bytes;
+                    job->progress = (completed + fraction) / num_algorithms;
+                }
+                return !job->cancel;
+            }, read_strategy_);
+
+            if (hash.empty()) {
+                hashes.clear();
+                break;
+            }
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+            spdlog::info("{} of {} took {:.2f} s ({})", algorithm, job->path, elapsed.count(),
+                         toString(read_strategy_));
+
+            if (has_stat && hash_cache_->setHash(job->path, before, hash, algorithm) &&
+                !hash_cache_->save())
+            {
+                spdlog::warn("Failed to save hash cache.");
+            }
+        }
+
+        hashes[algorithm] = hash;
+        completed++;
+    }
+
+    job->result.path = job->path;
+    job->result.hashes = hashes;
+    job->result.cancelled = job->cancel;
+    job->progress = 1.0f;
+    job->done = true;
+    just_annotate::wakeUi();
+}
@@ -0,0 +1,342 @@
+#include <just_annotate/keyframe_index.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+#include <gst/gst.h>
+#include <gst/app/app.h>
+#include <just_annotate/config_store.h>
+#include <just_annotate/hash.h>
+#include <just_annotate/ui_wake.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+namespace just_annotate {
+
+// links the video stream to the index sink, and everything else to a fakesink so that the demuxer
+// doesn't stop on unlinked pads
+void on_parsed_pad(GstElement* parsebin, GstPad* pad, gpointer data) {
+    GstElement* sink = static_cast<GstElement*>(data);
+
+    bool is_video = false;
+    GstCaps* caps = gst_pad_get_current_caps(pad);
+    if (!caps) {
+        caps = gst_pad_query_caps(pad, nullptr);
+    }
+    if (caps) {
+        if (gst_caps_get_size(caps) > 0) {
+            std::string name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+            is_video = name.rfind("video/", 0) == 0;
+        }
+        gst_caps_unref(caps);
+    }
+
+    GstPad* sink_pad = gst_element_get_static_pad(sink, "sink");
+    if (is_video && !gst_pad_is_linked(sink_pad)) {
+        gst_pad_link(pad, sink_pad);
+    }
+    else {
+        GstElement* fakesink = gst_element_factory_make("fakesink", nullptr);
+        g_object_set(fakesink, "sync", FALSE, "async", FALSE, nullptr);
+        gst_bin_add(GST_BIN(GST_ELEMENT_PARENT(parsebin)), fakesink);
+        gst_element_sync_state_with_parent(fakesink);
+
+        GstPad* fakesink_pad = gst_element_get_static_pad(fakesink, "sink");
+        gst_pad_link(pad, fakesink_pad);
+        gst_object_unref(fakesink_pad);
+    }
+    gst_object_unref(sink_pad);
+}
+
+KeyframeIndex::~KeyframeIndex() {
+    cancel_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+KeyframeIndex::Ptr KeyframeIndex::open(const std::string& path) {
+    auto index = std::shared_ptr<KeyframeIndex>(new KeyframeIndex());
+    index->path_ = path;
+    index->thread_ = std::thread(&KeyframeIndex::run, index.get());
+    return index;
+}
+
+bool KeyframeIndex::isReady() const {
+    return ready_;
+}
+
+size_t KeyframeIndex::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return keyframes_.size();
+}
+
+int64_t KeyframeIndex::keyframeBefore(int64_t time) const {
+    if (!ready_) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto keyframe_it = std::upper_bound(keyframes_.begin(), keyframes_.end(), time);
+    if (keyframe_it == keyframes_.begin()) {
+        return keyframes_.empty() ? -1 : keyframes_.front();
+    }
+
+    return *std::prev(keyframe_it);
+}
+
+int64_t KeyframeIndex::keyframeNearest(int64_t time) const {
+    if (!ready_) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (keyframes_.empty()) {
+        return -1;
+    }
+
+    auto keyframe_it = std::lower_bound(keyframes_.begin(), keyframes_.end(), time);
+    if (keyframe_it == keyframes_.end()) {
+        return keyframes_.back();
+    }
+    if (keyframe_it == keyframes_.begin()) {
+        return *keyframe_it;
+    }
+
+    int64_t after = *keyframe_it;
+    int64_t before = *std::prev(keyframe_it);
+    return time - before <= after - time ? before : after;
+}
+
+size_t KeyframeIndex::frameCount() const {
+    if (!ready_) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_.size();
+}
+
+int64_t KeyframeIndex::frameTime(int64_t frame) const {
+    if (!ready_) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frame < 0 || frame >= static_cast<int64_t>(frames_.size())) {
+        return -1;
+    }
+    return frames_[frame];
+}
+
+int64_t KeyframeIndex::frameAt(int64_t time) const {
+    if (!ready_) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frames_.empty()) {
+        return -1;
+    }
+
+    // times before the first frame still show the first frame
+    auto frame_it = std::upper_bound(frames_.begin(), frames_.end(), time);
+    if (frame_it == frames_.begin()) {
+        return 0;
+    }
+    return std::distance(frames_.begin(), frame_it) - 1;
+}
+
+void KeyframeIndex::run() {
+    // the fingerprint survives the video being moved or renamed, unlike its path
+    std::string video_fingerprint = fingerprint(path_);
+    if (video_fingerprint.empty()) {
+        return;
+    }
+    cache_path_ = findConfigDir() + "/.just_annotate_keyframes/" + video_fingerprint + ".json";
+
+    if (load()) {
+        spdlog::info("loaded {} keyframes and {} frames of {}", size(), frames_.size(), path_);
+        ready_ = true;
+        wakeUi();
+        return;
+    }
+
+    if (build()) {
+        spdlog::info("indexed {} keyframes and {} frames of {}", size(), frames_.size(), path_);
+        ready_ = true;
+        wakeUi();
+        save();
+    }
+}
+
+bool KeyframeIndex::load() {
+    std::ifstream infile(cache_path_);
+    if (!infile.is_open()) {
+        return false;
+    }
+
+    try {
+        json j;
+        infile >> j;
+
+        // indexes from before frames were indexed are rebuilt
+        if (!j.contains("frames")) {
+            return false;
+        }
+
+        std::vector<int64_t> keyframes;
+        j.at("keyframes").get_to(keyframes);
+
+        // runs of equal frame durations, which a constant frame rate reduces to a single one
+        std::vector<int64_t> frames;
+        int64_t time = j.at("frames").at("first").get<int64_t>();
+        frames.push_back(time);
+        for (const auto& run: j.at("frames").at("durations")) {
+            int64_t duration = run.at(0).get<int64_t>();
+            int64_t count = run.at(1).get<int64_t>();
+            for (int64_t i = 0; i < count; i++) {
+                time += duration;
+                frames.push_back(time);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        keyframes_ = keyframes;
+        frames_ = frames;
+        return !keyframes_.empty();
+    }
+    catch (json::exception& e) {
+        spdlog::warn("Discarding unreadable keyframe index {}: {}", cache_path_, e.what());
+        return false;
+    }
+}
+
+bool KeyframeIndex::build() {
+    GstElement* pipeline = gst_pipeline_new(nullptr);
+    GstElement* source = gst_element_factory_make("filesrc", nullptr);
+    GstElement* parse = gst_element_factory_make("parsebin", nullptr);
+    GstElement* sink = gst_element_factory_make("appsink", nullptr);
+    if (!pipeline || !source || !parse || !sink) {
+        spdlog::error("Failed to create keyframe index pipeline.");
+        for (auto element: {pipeline, source, parse, sink}) {
+            if (element) {
+                gst_object_unref(gst_object_ref_sink(element));
+            }
+        }
+        return false;
+    }
+
+    g_object_set(source, "location", path_.c_str(), nullptr);
+    g_object_set(sink, "sync", FALSE, "max-buffers", 256, nullptr);
+    gst_bin_add_many(GST_BIN(pipeline), source, parse, sink, nullptr);
+    gst_element_link(source, parse);
+    g_signal_connect(parse, "pad-added", G_CALLBACK(on_parsed_pad), sink);
+
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    bool complete = false;
+    std::vector<int64_t> keyframes;
+    std::vector<int64_t> frames;
+    while (!cancel_) {
+        GstMessage* error = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+        if (error) {
+            GError* gerror = nullptr;
+            gst_message_parse_error(error, &gerror, nullptr);
+            spdlog::warn("Failed to index keyframes of {}: {}", path_, gerror->message);
+            g_clear_error(&gerror);
+            gst_message_unref(error);
+            break;
+        }
+
+        GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), 100 * GST_MSECOND);
+        if (!sample) {
+            if (gst_app_sink_is_eos(GST_APP_SINK(sink))) {
+                complete = true;
+                break;
+            }
+            continue;
+        }
+
+        GstBuffer* buffer = gst_sample_get_buffer(sample);
+        if (buffer) {
+            guint64 time = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer)
+                                                            : GST_BUFFER_DTS(buffer);
+            const GstSegment* segment = gst_sample_get_segment(sample);
+            if (segment && time != GST_CLOCK_TIME_NONE) {
+                time = gst_segment_to_stream_time(segment, GST_FORMAT_TIME, time);
+            }
+            if (time != GST_CLOCK_TIME_NONE) {
+                frames.push_back(static_cast<int64_t>(time));
+                if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+                    keyframes.push_back(static_cast<int64_t>(time));
+                }
+            }
+        }
+        gst_sample_unref(sample);
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(bus);
+    gst_object_unref(pipeline);
+
+    if (!complete || keyframes.empty()) {
+        return false;
+    }
+
+    // frames arrive in decoding order, which differs from presentation order with B-frames
+    for (auto times: {&keyframes, &frames}) {
+        std::sort(times->begin(), times->end());
+        times->erase(std::unique(times->begin(), times->end()), times->end());
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    keyframes_ = keyframes;
+    frames_ = frames;
+    return true;
+}
+
+bool KeyframeIndex::save() const {
+    std::error_code ec;
+    fs::create_directories(fs::path(cache_path_).parent_path(), ec);
+
+    json j;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        j["keyframes"] = keyframes_;
+
+        json durations = json::array();
+        for (size_t i = 1; i < frames_.size(); i++) {
+            int64_t duration = frames_[i] - frames_[i - 1];
+            if (!durations.empty() && durations.back()[0] == duration) {
+                durations.back()[1] = durations.back()[1].get<int64_t>() + 1;
+            }
+            else {
+                durations.push_back({duration, 1});
+            }
+        }
+        j["frames"] = {{"first", frames_.front()}, {"durations", durations}};
+    }
+
+    std::string tmp_path = cache_path_ + ".tmp";
+    std::ofstream outfile(tmp_path);
+    if (outfile.is_open()) {
+        outfile << j << std::endl;
+        outfile.close();
+
+        fs::rename(tmp_path, cache_path_, ec);
+        if (!ec) {
+            return true;
+        }
+    }
+
+    spdlog::error("Failed to save keyframe index to: {}", cache_path_);
+    return false;
+}
+
+} // namespace just_annotate
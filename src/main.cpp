@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <csignal>
+#include <cstdio>
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <vector>
 
@@ -14,14 +18,30 @@
 #include <just_annotate/annotation_class_dialog.h>
 #include <just_annotate/annotation_store.h>
 #include <just_annotate/config_store.h>
+#include <just_annotate/file_locator.h>
 #include <just_annotate/hash.h>
+#include <just_annotate/hash_cache.h>
+#include <just_annotate/hash_cache_dialog.h>
+#include <just_annotate/hash_worker.h>
+#include <just_annotate/media_index.h>
 #include <just_annotate/imgui_util.h>
 #include <just_annotate/multi_span_widget.h>
+#include <just_annotate/thumbnail_strip.h>
+#include <just_annotate/ui_wake.h>
 #include <just_annotate/video_file.h>
+#include <just_annotate/video_queue.h>
 #include <spdlog/spdlog.h>
 
 CMRC_DECLARE(just_annotate::rc);
 
+// height of the thumbnail strip above the position slider
+const float FILMSTRIP_HEIGHT = 36.0f;
+// longest the main loop sleeps while idle, in seconds, and while background jobs show progress
+const double IDLE_WAIT_TIMEOUT = 1.0;
+const double PROGRESS_WAIT_TIMEOUT = 0.1;
+// frames drawn after waking up before sleeping again, which ImGui needs to settle after input
+const int SETTLE_FRAMES = 3;
+
 bool try_exit = false;
 
 void handle_signal(int signal) {
@@ -52,14 +72,163 @@ void framebuffer_size_callback(GLFWwindow* /* window */, int width, int height)
     io.DisplaySize = ImVec2(static_cast<float>(width), static_cast<float>(height));
 }
 
-std::string get_file_hash(const std::string& path) {
-    std::string hash = sha256(path);
-    if (hash.empty()) {
-        spdlog::error("Failed to get hash of video: {}", path);
-        ImGui::OpenPopup("Error##Hash");
+void load_file_annotations(AnnotationStore& project,
+                           const std::vector<AnnotationClass>& annotation_classes,
+                           AnnotationState& annotations, AnnotationHistory& annotation_history)
+{
+    // spans drawn while the hash was being computed are kept and merged with the saved ones
+    bool has_edits = std::any_of(annotations.begin(), annotations.end(),
+                                 [](const auto& spans) { return !spans.empty(); });
+
+    bool has_saved = false;
+    auto saved_file_annotations = project.getAnnotations();
+    for (const auto& saved_annotations: saved_file_annotations) {
+        for (size_t i = 0; i < annotation_classes.size(); i++) {
+            if (annotation_classes[i].id == saved_annotations.id && !saved_annotations.spans.empty()) {
+                annotations[i].insert(annotations[i].end(), saved_annotations.spans.begin(),
+                                      saved_annotations.spans.end());
+                has_saved = true;
+            }
+        }
+    }
+
+    if (!has_edits) {
+        annotation_history.initialize(annotations);
+    }
+    else if (has_saved) {
+        annotation_history.update(annotations);
+    }
+}
+
+void bind_file_annotations(AnnotationStore& project, const std::string& path,
+                           const FileHashes& hashes, const std::string& preferred_algorithm,
+                           const std::string& fingerprint,
+                           const std::vector<AnnotationClass>& annotation_classes,
+                           AnnotationState& annotations, AnnotationHistory& annotation_history)
+{
+    std::filesystem::path fs_path(path);
+    project.setFile(fs_path.filename().string(), hashes, preferred_algorithm, fingerprint);
+
+    HashCacheEntry entry;
+    if (statFile(path, entry)) {
+        project.setFileLocation(normalizePath(path), entry.size);
+    }
+    load_file_annotations(project, annotation_classes, annotations, annotation_history);
+}
+
+// a video is compared against the project with every algorithm the project already uses, and new
+// files are added with the preferred one
+std::set<std::string> required_hash_algorithms(const AnnotationStore& project,
+                                               const std::string& preferred_algorithm)
+{
+    auto algorithms = project.getHashAlgorithms();
+    algorithms.insert(preferred_algorithm);
+    return algorithms;
+}
+
+// Returns the location of the next project file after the current one that is known to exist, or
+// the first one if no file is current.
+std::string next_located_file(const AnnotationStore& project, bool forward) {
+    auto files = project.getFiles();
+    if (!forward) {
+        std::reverse(files.begin(), files.end());
+    }
+
+    std::string current_hash = project.getFileHash();
+    auto current_it = std::find_if(files.begin(), files.end(),
+                                   [&](const auto& file) { return file.hash == current_hash; });
+    size_t start = current_it == files.end() ? 0 : current_it - files.begin() + 1;
+    for (size_t i = 0; i < files.size(); i++) {
+        const auto& file = files[(start + i) % files.size()];
+        std::string location = project.getFileLocation(file.hash);
+        std::error_code ec;
+        if (file.hash != current_hash && !location.empty() &&
+            std::filesystem::exists(location, ec))
+        {
+            return location;
+        }
     }
 
-    return hash;
+    return {};
+}
+
+bool has_hashes(const FileHashes& hashes, const std::set<std::string>& algorithms) {
+    for (const auto& algorithm: algorithms) {
+        if (hashes.count(algorithm) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// each cell of the strip shows the thumbnail closest to the time at its center
+void draw_filmstrip(const just_annotate::ThumbnailStrip& thumbnails, double duration, float height) {
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    float width = ImGui::GetContentRegionAvail().x;
+    ImGui::Dummy(ImVec2(width, height));
+    if (duration <= 0 || width <= 0) {
+        return;
+    }
+
+    float cell_width = height * just_annotate::ThumbnailStrip::THUMBNAIL_WIDTH /
+                       just_annotate::ThumbnailStrip::THUMBNAIL_HEIGHT;
+    int cells = std::max(1, static_cast<int>(std::ceil(width / cell_width)));
+    cell_width = width / cells;
+
+    auto draw_list = ImGui::GetWindowDrawList();
+    auto texture_id = (void*)(intptr_t)thumbnails.getTextureId();
+    for (int i = 0; i < cells; i++) {
+        just_annotate::ThumbnailStrip::Thumbnail thumbnail;
+        if (thumbnails.find((i + 0.5) * duration / cells, thumbnail)) {
+            draw_list->AddImage(texture_id, ImVec2(pos.x + i * cell_width, pos.y),
+                                ImVec2(pos.x + (i + 1) * cell_width, pos.y + height),
+                                ImVec2(thumbnail.u0, thumbnail.v0),
+                                ImVec2(thumbnail.u1, thumbnail.v1));
+        }
+    }
+}
+
+// tooltip with the thumbnail under the mouse while the last item, which spans the timeline, is
+// hovered
+void show_thumbnail_preview(const just_annotate::ThumbnailStrip& thumbnails, double duration) {
+    if (!ImGui::IsItemHovered() || duration <= 0) {
+        return;
+    }
+
+    ImVec2 item_min = ImGui::GetItemRectMin();
+    ImVec2 item_max = ImGui::GetItemRectMax();
+    float fraction = (ImGui::GetIO().MousePos.x - item_min.x) / (item_max.x - item_min.x);
+    double time = std::clamp(static_cast<double>(fraction), 0.0, 1.0) * duration;
+
+    just_annotate::ThumbnailStrip::Thumbnail thumbnail;
+    if (!thumbnails.find(time, thumbnail)) {
+        return;
+    }
+
+    ImGui::BeginTooltip();
+    ImGui::Image((void*)(intptr_t)thumbnails.getTextureId(),
+                 ImVec2(just_annotate::ThumbnailStrip::THUMBNAIL_WIDTH,
+                        just_annotate::ThumbnailStrip::THUMBNAIL_HEIGHT),
+                 ImVec2(thumbnail.u0, thumbnail.v0), ImVec2(thumbnail.u1, thumbnail.v1));
+    ImGui::Text("%.3f s", time);
+    ImGui::EndTooltip();
+}
+
+// one press of J or L: starts playing in that direction, or doubles the speed if it's already
+// playing that way, or with shift, halves it for slow motion
+void shuttle(just_annotate::VideoFile& video_file, bool forward, bool slower) {
+    double direction = forward ? 1.0 : -1.0;
+    double rate = video_file.getRate();
+    double speed = slower ? 0.5 : 1.0;
+    if (!video_file.isPaused() && rate * direction > 0) {
+        speed = slower ? std::abs(rate) * 0.5 : std::abs(rate) * 2.0;
+    }
+
+    // while playing, the rate change is scheduled like a seek, resuming would seek right away
+    video_file.setRate(direction * speed);
+    if (video_file.isPaused()) {
+        video_file.play();
+    }
 }
 
 int main(int argc, char* argv[]) {
@@ -67,6 +236,12 @@ int main(int argc, char* argv[]) {
     std::signal(SIGINT, handle_signal);
 
     auto config_state = getConfig();
+    auto hash_cache = HashCache::open();
+    HashWorker hash_worker(hash_cache);
+    hash_worker.setReadStrategy(hashReadStrategyFromString(config_state.hash_read_strategy));
+    auto media_index = MediaIndex::open();
+    LibraryScanner library_scanner(media_index, hash_cache);
+    FileLocator file_locator(hash_cache);
 
     auto rc_filesystem = cmrc::just_annotate::rc::get_filesystem();
     auto fa_ttf        = rc_filesystem.open("fontawesome-webfont.ttf");
@@ -76,6 +251,7 @@ int main(int argc, char* argv[]) {
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
         return 1;
+    just_annotate::setWakeHandler(glfwPostEmptyEvent);
 
     // Create window with graphics context
     GLFWwindow* window = glfwCreateWindow(config_state.window_width, config_state.window_height, "JustAnnotate", nullptr, nullptr);
@@ -121,6 +297,9 @@ int main(int argc, char* argv[]) {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     just_annotate::VideoFile::init(argc, argv);
+    if (config_state.gl_output) {
+        just_annotate::VideoFile::initGL();
+    }
 
     // create a video file browser instance
     ImGui::FileBrowser videoFileDialog;
@@ -136,22 +315,56 @@ int main(int argc, char* argv[]) {
     saveProjectDialog.SetTitle("Save Project");
     saveProjectDialog.SetTypeFilters({".json"});
 
+    ImGui::FileBrowser libraryDialog(ImGuiFileBrowserFlags_SelectDirectory);
+    libraryDialog.SetTitle("Index Library");
+
+    ImGui::FileBrowser searchRootDialog(ImGuiFileBrowserFlags_SelectDirectory);
+    searchRootDialog.SetTitle("Add Search Root");
+
+    ImGui::FileBrowser queueDirectoryDialog(ImGuiFileBrowserFlags_SelectDirectory);
+    queueDirectoryDialog.SetTitle("Queue Directory");
+
+    ImGui::FileBrowser queueListDialog;
+    queueListDialog.SetTitle("Queue List");
+    queueListDialog.SetTypeFilters({".txt"});
+
     AnnotationClassDialog annotationClassDialog;
 
+    HashCacheDialog hashCacheDialog;
+    hashCacheDialog.SetTitle("Hash Cache");
+
     // Our state
     std::string filepath;
     std::string project_path;
     std::string open_recent_path;
     std::string open_recent_video;
     std::string last_title;
+    FileHashes video_hashes;
+    std::string video_fingerprint;
+    // spans loaded by a fingerprint match, until the full hash confirms or refutes it
+    AnnotationState fingerprint_spans;
+    bool hash_cancelled = false;
+
+    // scans interrupted by the last exit are resumed in the background, one root at a time
+    auto pending_roots = media_index->getPendingRoots();
+    std::deque<std::string> library_roots(pending_roots.begin(), pending_roots.end());
     auto project = std::make_shared<AnnotationStore>();
     bool use_dark_theme = true;
     just_annotate::VideoFile::Ptr video_file;
+    just_annotate::ThumbnailStrip::Ptr thumbnails;
+    just_annotate::VideoQueue::Ptr video_queue;
     bool add_annotation_class = false;
+    bool show_hash_cache = false;
+    bool show_statistics = false;
+    bool native_resolution = false;
     bool new_project = false;
+    // opening another video waits for confirmation while there are spans that can't be stored
+    bool confirm_video_switch = false;
     int edit_annotation_class = -1;
     float seek_position     = 0.0;
     bool is_seeking = false;
+    // last slider position while dragging, which is only seeked to accurately on release
+    float scrub_position = -1.0;
     bool pause_for_seeking = false;
     float video_position    = 0.0;
     std::vector<AnnotationClass> annotation_classes;
@@ -169,9 +382,69 @@ int main(int argc, char* argv[]) {
     float last_image_height = 0;
     ImVec2 remaining_space(0, 0);
 
+    int settle_frames = 0;
+    auto load_start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> load_asleep{0};
+    int load_frames = 0;
+    float ui_fps = 0;
+    float ui_asleep_percent = 0;
+
     // Main loop
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+        // while nothing on screen can change by itself, the loop sleeps until there's input, a
+        // decoded frame or a finished background job rather than redrawing at the display rate
+        bool is_idle = (!video_file || video_file->isIdle()) &&
+                       (!video_queue || !video_queue->isPrerolling()) && library_roots.empty() &&
+                       !is_seeking && scrub_position < 0;
+        bool is_background_busy = hash_worker.isBusy() || library_scanner.isBusy() ||
+                                  file_locator.isBusy() ||
+                                  (thumbnails && !thumbnails->isComplete());
+        auto wait_start = std::chrono::steady_clock::now();
+        if (is_idle && settle_frames == 0) {
+            just_annotate::setUiIdle(true);
+            glfwWaitEventsTimeout(is_background_busy ? PROGRESS_WAIT_TIMEOUT : IDLE_WAIT_TIMEOUT);
+            just_annotate::setUiIdle(false);
+            settle_frames = SETTLE_FRAMES;
+        }
+        else {
+            glfwPollEvents();
+            if (settle_frames > 0) {
+                settle_frames--;
+            }
+        }
+
+        auto wait_end = std::chrono::steady_clock::now();
+        load_asleep += wait_end - wait_start;
+        load_frames++;
+        std::chrono::duration<double> load_elapsed = wait_end - load_start;
+        if (load_elapsed.count() >= 1.0) {
+            ui_fps = static_cast<float>(load_frames / load_elapsed.count());
+            ui_asleep_percent = static_cast<float>(100.0 * load_asleep / load_elapsed);
+            load_start = wait_end;
+            load_asleep = std::chrono::duration<double>::zero();
+            load_frames = 0;
+        }
+
+        if (!library_scanner.isBusy() && !library_roots.empty()) {
+            library_scanner.start(library_roots.front(), {config_state.hash_algorithm});
+            library_roots.pop_front();
+        }
+        if (library_scanner.poll()) {
+            spdlog::info("Finished indexing {}", library_scanner.getRoot());
+        }
+
+        std::map<std::string, std::string> located_files;
+        if (file_locator.poll(located_files)) {
+            spdlog::info("Located {} project videos", located_files.size());
+            project->setFileLocations(located_files);
+            if (!video_file && open_recent_video.empty()) {
+                open_recent_video = next_located_file(*project, true);
+            }
+        }
+
+        // spans can't be stored until the full hash has identified the video they belong to, a
+        // fingerprint match could still turn out to be a different file
+        bool can_save = !hash_worker.isBusy() && (!project->hasFile() || !video_hashes.empty());
 
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -218,7 +491,7 @@ int main(int argc, char* argv[]) {
                 }
                 ImGui::EndDisabled();
 
-                ImGui::BeginDisabled(project_path.empty());
+                ImGui::BeginDisabled(project_path.empty() || !can_save);
                 if (ImGui::MenuItem("Save Project", "Ctrl+S")) {
 
                     for (size_t i = 0; i < annotation_classes.size(); i++) {
@@ -233,9 +506,11 @@ int main(int argc, char* argv[]) {
                 }
                 ImGui::EndDisabled();
 
+                ImGui::BeginDisabled(!can_save);
                 if (ImGui::MenuItem("Save As...")) {
                     saveProjectDialog.Open();
                 }
+                ImGui::EndDisabled();
 
                 ImGui::Separator();
 
@@ -256,6 +531,17 @@ int main(int argc, char* argv[]) {
                 }
                 ImGui::EndDisabled();
 
+                if (ImGui::MenuItem("Queue Directory...")) {
+                    queueDirectoryDialog.Open();
+                }
+                if (ImGui::MenuItem("Queue List...")) {
+                    queueListDialog.Open();
+                }
+
+                if (ImGui::MenuItem("Index Library...")) {
+                    libraryDialog.Open();
+                }
+
                 ImGui::Separator();
 
                 if (ImGui::MenuItem("Exit", "Ctrl+X")) {
@@ -296,6 +582,98 @@ int main(int argc, char* argv[]) {
                 ImGui::EndMenu();
             }
 
+            if (ImGui::BeginMenu("Videos")) {
+                if (ImGui::MenuItem("Next Video", "Ctrl+PgDn")) {
+                    open_recent_video = next_located_file(*project, true);
+                }
+                if (ImGui::MenuItem("Previous Video", "Ctrl+PgUp")) {
+                    open_recent_video = next_located_file(*project, false);
+                }
+
+                if (video_queue) {
+                    ImGui::Separator();
+                    int queue_index = video_queue->getIndex();
+                    int queue_size = static_cast<int>(video_queue->size());
+                    ImGui::BeginDisabled(queue_index + 1 >= queue_size);
+                    if (ImGui::MenuItem("Next in Queue", "PgDn")) {
+                        open_recent_video = video_queue->getEntry(queue_index + 1);
+                    }
+                    ImGui::EndDisabled();
+                    ImGui::BeginDisabled(queue_index <= 0);
+                    if (ImGui::MenuItem("Previous in Queue", "PgUp")) {
+                        open_recent_video = video_queue->getEntry(queue_index - 1);
+                    }
+                    ImGui::EndDisabled();
+                    if (ImGui::BeginMenu("Queue")) {
+                        for (int i = 0; i < queue_size; i++) {
+                            std::string label =
+                              std::filesystem::path(video_queue->getEntry(i)).filename().string();
+                            if (video_queue->isPrerolled(i)) {
+                                label += " (ready)";
+                            }
+                            if (ImGui::MenuItem(label.c_str(), nullptr, i == queue_index)) {
+                                open_recent_video = video_queue->getEntry(i);
+                            }
+                        }
+                        ImGui::EndMenu();
+                    }
+                    if (ImGui::MenuItem("Close Queue")) {
+                        video_queue.reset();
+                    }
+                }
+
+                auto files = project->getFiles();
+                if (!files.empty()) {
+                    ImGui::Separator();
+                }
+                for (const auto& file: files) {
+                    std::string location = project->getFileLocation(file.hash);
+                    std::error_code ec;
+                    bool exists = !location.empty() && std::filesystem::exists(location, ec);
+                    std::string label = file.names.empty() ? file.hash : *file.names.begin();
+                    label += "##" + file.hash;
+                    if (ImGui::MenuItem(label.c_str(), nullptr, file.hash == project->getFileHash(),
+                                        exists))
+                    {
+                        open_recent_video = location;
+                    }
+                    if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+                        ImGui::SetTooltip("%s", exists ? location.c_str() : "not found");
+                    }
+                }
+
+                ImGui::Separator();
+
+                ImGui::BeginDisabled(config_state.search_roots.empty() || file_locator.isBusy());
+                if (ImGui::MenuItem("Locate Missing Videos")) {
+                    file_locator.start(project->getMissingFiles(), config_state.search_roots);
+                }
+                ImGui::EndDisabled();
+
+                if (ImGui::MenuItem("Add Search Root...")) {
+                    searchRootDialog.Open();
+                }
+
+                ImGui::BeginDisabled(config_state.search_roots.empty());
+                if (ImGui::BeginMenu("Remove Search Root")) {
+                    int remove_root = -1;
+                    for (size_t i = 0; i < config_state.search_roots.size(); i++) {
+                        if (ImGui::MenuItem(config_state.search_roots[i].c_str())) {
+                            remove_root = static_cast<int>(i);
+                        }
+                    }
+                    if (remove_root >= 0) {
+                        config_state.search_roots.erase(config_state.search_roots.begin() +
+                                                        remove_root);
+                        saveConfig(config_state);
+                    }
+                    ImGui::EndMenu();
+                }
+                ImGui::EndDisabled();
+
+                ImGui::EndMenu();
+            }
+
             if (ImGui::BeginMenu("Preferences")) {
                 if (use_dark_theme) {
                     if (ImGui::MenuItem("Style: Light")) {
@@ -308,6 +686,83 @@ int main(int argc, char* argv[]) {
                         use_dark_theme = true;
                     }
                 }
+
+                ImGui::Separator();
+
+                if (ImGui::BeginMenu("Identity Hash")) {
+                    for (const auto& algorithm: {HASH_SHA256, HASH_SHA256_TREE}) {
+                        bool selected = config_state.hash_algorithm == algorithm;
+                        if (ImGui::MenuItem(algorithm.c_str(), nullptr, selected)) {
+                            config_state.hash_algorithm = algorithm;
+                        }
+                    }
+                    ImGui::EndMenu();
+                }
+
+                if (ImGui::BeginMenu("Hash I/O")) {
+                    for (auto strategy: {HashReadStrategy::AUTO, HashReadStrategy::MMAP,
+                                         HashReadStrategy::PREAD, HashReadStrategy::STREAM}) {
+                        bool selected = config_state.hash_read_strategy == toString(strategy);
+                        if (ImGui::MenuItem(toString(strategy).c_str(), nullptr, selected)) {
+                            config_state.hash_read_strategy = toString(strategy);
+                            hash_worker.setReadStrategy(strategy);
+                        }
+                    }
+                    ImGui::EndMenu();
+                }
+
+                if (ImGui::BeginMenu("Frame Cache")) {
+                    for (int size_mb: {256, 512, 1024, 2048, 4096}) {
+                        std::string label = std::to_string(size_mb) + " MB";
+                        bool selected = config_state.frame_cache_mb == size_mb;
+                        if (ImGui::MenuItem(label.c_str(), nullptr, selected)) {
+                            config_state.frame_cache_mb = size_mb;
+                            if (video_file) {
+                                video_file->setFrameCacheSize(static_cast<size_t>(size_mb) << 20);
+                            }
+                        }
+                    }
+                    ImGui::EndMenu();
+                }
+
+                if (ImGui::BeginMenu("Frame Memory")) {
+                    for (int size_mb: {16, 32, 64, 128, 256}) {
+                        std::string label = std::to_string(size_mb) + " MB";
+                        bool selected = config_state.frame_memory_mb == size_mb;
+                        if (ImGui::MenuItem(label.c_str(), nullptr, selected)) {
+                            config_state.frame_memory_mb = size_mb;
+                            if (video_file) {
+                                video_file->setFrameMemory(static_cast<size_t>(size_mb) << 20);
+                            }
+                        }
+                    }
+                    ImGui::EndMenu();
+                }
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Decoded frames kept after being displayed");
+                }
+
+                if (ImGui::MenuItem("GL Video Output", nullptr, config_state.gl_output)) {
+                    config_state.gl_output = !config_state.gl_output;
+                    if (config_state.gl_output) {
+                        just_annotate::VideoFile::initGL();
+                    }
+                }
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Keeps decoded frames on the GPU, for videos opened afterwards");
+                }
+
+                if (ImGui::MenuItem("Hash Cache...")) {
+                    show_hash_cache = true;
+                }
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("View")) {
+                if (ImGui::MenuItem("Native Resolution", nullptr, &native_resolution) && video_file) {
+                    video_file->setNativeResolution(native_resolution);
+                }
+                ImGui::MenuItem("Statistics", nullptr, &show_statistics);
                 ImGui::EndMenu();
             }
 
@@ -317,12 +772,43 @@ int main(int argc, char* argv[]) {
                 ImGui::EndMenu();
             }
 
+            if (library_scanner.isBusy()) {
+                size_t total = library_scanner.getTotal();
+                size_t completed = library_scanner.getCompleted();
+                std::string overlay = "indexing " + std::to_string(completed) + "/" +
+                                      std::to_string(total);
+                ImGui::ProgressBar(total > 0 ? static_cast<float>(completed) / total : 0.0f,
+                                   ImVec2(160.0f, ImGui::GetTextLineHeight()), overlay.c_str());
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("%s", library_scanner.getRoot().c_str());
+                }
+                if (ImGui::SmallButton("Cancel##Index")) {
+                    // an explicit cancel isn't resumed on the next start
+                    library_roots.clear();
+                    library_scanner.cancel();
+                    media_index->removePendingRoot(library_scanner.getRoot());
+                    media_index->save();
+                }
+            }
+
+            if (file_locator.isBusy()) {
+                size_t total = file_locator.getTotal();
+                size_t completed = file_locator.getCompleted();
+                std::string overlay = "locating " + std::to_string(completed) + "/" +
+                                      std::to_string(total);
+                ImGui::ProgressBar(total > 0 ? static_cast<float>(completed) / total : 0.0f,
+                                   ImVec2(160.0f, ImGui::GetTextLineHeight()), overlay.c_str());
+                if (ImGui::SmallButton("Cancel##Locate")) {
+                    file_locator.cancel();
+                }
+            }
+
             ImGui::EndMenuBar();
         }
 
         if (!ImGui::IsPopupOpen(NULL, ImGuiPopupFlags_AnyPopup)) {
             // check if save shortcut key was pressed
-            if (!project_path.empty()) {
+            if (!project_path.empty() && can_save) {
                 if (io.KeyCtrl && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_S))) {
                     for (size_t i = 0; i < annotation_classes.size(); i++) {
                         if(!project->setAnnotations({annotation_classes[i].id, annotations[i]})) {
@@ -340,6 +826,25 @@ int main(int argc, char* argv[]) {
                 videoFileDialog.Open();
             }
 
+            if (io.KeyCtrl && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_PageDown))) {
+                open_recent_video = next_located_file(*project, true);
+            }
+            if (io.KeyCtrl && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_PageUp))) {
+                open_recent_video = next_located_file(*project, false);
+            }
+
+            if (video_queue && !io.KeyCtrl) {
+                int queue_index = video_queue->getIndex();
+                if (ImGui::IsKeyPressed(ImGuiKey_PageDown, false) &&
+                    queue_index + 1 < static_cast<int>(video_queue->size()))
+                {
+                    open_recent_video = video_queue->getEntry(queue_index + 1);
+                }
+                if (ImGui::IsKeyPressed(ImGuiKey_PageUp, false) && queue_index > 0) {
+                    open_recent_video = video_queue->getEntry(queue_index - 1);
+                }
+            }
+
             // check if exit shortcut key was pressed
             if (io.KeyCtrl && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_X))) {
                 try_exit = true;
@@ -373,6 +878,51 @@ int main(int argc, char* argv[]) {
             }
         }
 
+        HashWorker::Result hash_result;
+        if (hash_worker.poll(hash_result) && video_file && hash_result.path == video_file->getPath()) {
+            if (hash_result.cancelled) {
+                hash_cancelled = true;
+            }
+            else if (hash_result.hashes.empty()) {
+                spdlog::error("Failed to get hash of video: {}", hash_result.path);
+                ImGui::OpenPopup("Error##Hash");
+            }
+            else {
+                video_hashes = hash_result.hashes;
+                if (project->hasFile() && project->matchesFile(video_hashes)) {
+                    // the fingerprint match is confirmed, the loaded spans are already correct
+                    std::filesystem::path fs_path(hash_result.path);
+                    project->setFile(fs_path.filename().string(), video_hashes,
+                                     config_state.hash_algorithm, video_fingerprint);
+                }
+                else {
+                    if (project->hasFile()) {
+                        spdlog::warn("Fingerprint of {} matched {}, but the full hash differs",
+                                     hash_result.path, project->getFileHash());
+                        // the spans of the other file are dropped, anything drawn or changed
+                        // since is carried over to this one
+                        for (size_t i = 0; i < annotations.size() && i < fingerprint_spans.size();
+                             i++)
+                        {
+                            for (const auto& span: fingerprint_spans[i]) {
+                                auto span_it = std::find(annotations[i].begin(),
+                                                         annotations[i].end(), span);
+                                if (span_it != annotations[i].end()) {
+                                    annotations[i].erase(span_it);
+                                }
+                            }
+                        }
+                        annotation_history.initialize(annotations);
+                        ImGui::OpenPopup("Warning##Fingerprint");
+                    }
+                    bind_file_annotations(*project, hash_result.path, video_hashes,
+                                          config_state.hash_algorithm, video_fingerprint,
+                                          annotation_classes, annotations, annotation_history);
+                }
+                fingerprint_spans.clear();
+            }
+        }
+
         if (!video_file) {
             std::string open_label = "[ Open Vide File ]";
             auto windowSize        = ImGui::GetWindowSize();
@@ -412,6 +962,19 @@ int main(int argc, char* argv[]) {
                 if (ImGui::IsKeyPressed(ImGuiKey_Space)) {
                     video_file->pause(!video_file->isPaused());
                 }
+
+                // J/K/L shuttle control
+                if (!ImGui::GetIO().WantTextInput && !ImGui::GetIO().KeyCtrl) {
+                    if (ImGui::IsKeyPressed(ImGuiKey_J, false)) {
+                        shuttle(*video_file, false, ImGui::GetIO().KeyShift);
+                    }
+                    if (ImGui::IsKeyPressed(ImGuiKey_K, false)) {
+                        video_file->pause(true);
+                    }
+                    if (ImGui::IsKeyPressed(ImGuiKey_L, false)) {
+                        shuttle(*video_file, true, ImGui::GetIO().KeyShift);
+                    }
+                }
             }
 
             auto windowSize = ImGui::GetWindowSize();
@@ -419,6 +982,27 @@ int main(int argc, char* argv[]) {
             ImGui::SetCursorPosX((windowSize.x - textSize.x) * 0.5f);
             ImGui::Text("%s", filepath.c_str());
 
+            if (hash_worker.isBusy()) {
+                ImGui::SameLine();
+                ImGui::ProgressBar(hash_worker.getProgress(), ImVec2(120.0f, ImGui::GetTextLineHeight()),
+                                   project->hasFile() ? "verifying" : "hashing");
+                ImGui::SameLine();
+                if (ImGui::SmallButton("Cancel##Hash")) {
+                    hash_worker.cancel();
+                }
+            }
+            else if (hash_cancelled) {
+                ImGui::SameLine();
+                ImGui::TextDisabled(project->hasFile() ? "(not verified, spans won't be saved)"
+                                                       : "(not hashed, spans won't be saved)");
+                ImGui::SameLine();
+                if (ImGui::SmallButton("Retry##Hash")) {
+                    hash_cancelled = false;
+                    hash_worker.start(video_file->getPath(),
+                                      required_hash_algorithms(*project, config_state.hash_algorithm));
+                }
+            }
+
             ImGui::SetNextItemAllowOverlap();
 
             ImVec2 uv_min     = ImVec2(0.0f, 0.0f);             // Top-left
@@ -433,14 +1017,35 @@ int main(int argc, char* argv[]) {
 
             last_image_height = image_height;
 
+            // decoding follows the size the video is drawn at, in framebuffer pixels
+            ImVec2 framebuffer_scale = ImGui::GetIO().DisplayFramebufferScale;
+            video_file->setDisplaySize(static_cast<int>(image_width * framebuffer_scale.x),
+                                       static_cast<int>(image_height * framebuffer_scale.y));
+
             ImGui::SetCursorPosX((windowSize.x - image_width) * 0.5f);
             auto texture_id = video_file->getTextureId();
             ImGui::Image((void*)(intptr_t)texture_id, ImVec2(image_width, image_height), uv_min, uv_max);
 
+            if (thumbnails) {
+                draw_filmstrip(*thumbnails, video_file->getDuration(), FILMSTRIP_HEIGHT);
+                show_thumbnail_preview(*thumbnails, video_file->getDuration());
+            }
+
             ImGui::PushItemWidth(-1);
             video_position = video_file->getPosition();
             seek_position  = video_position;
-            ImGui::SliderFloat("##position", &seek_position, 0.0f, video_file->getDuration(), "%.3f s");
+            std::string position_format = "%.3f s";
+            int64_t displayed_frame = video_file->getDisplayedFrame();
+            if (displayed_frame >= 0) {
+                position_format += "  frame " + std::to_string(displayed_frame);
+            }
+            if (!video_file->isPaused() && video_file->getRate() != 1.0) {
+                char rate_label[32];
+                snprintf(rate_label, sizeof(rate_label), "  %gx", video_file->getRate());
+                position_format += rate_label;
+            }
+            ImGui::SliderFloat("##position", &seek_position, 0.0f, video_file->getDuration(),
+                               position_format.c_str());
             if (!is_seeking && ImGui::IsItemActive()) {
                 pause_for_seeking = !video_file->isPaused();
             }
@@ -458,9 +1063,21 @@ int main(int argc, char* argv[]) {
                 ImGui::PushID(class_id_label.c_str());
                 if (MultiSpan(name_label.c_str(), annotations[i], seek_position, 0,
                               video_file->getDuration(), annotation_classes[i].color)) {
+                    // span edges sit on frame boundaries, so that they cover whole frames
+                    for (auto& span: annotations[i]) {
+                        span.first = video_file->snapToFrame(span.first);
+                        span.second = video_file->snapToFrame(span.second);
+                    }
+                    annotations[i].erase(
+                      std::remove_if(annotations[i].begin(), annotations[i].end(),
+                                     [](const auto& span) { return span.first >= span.second; }),
+                      annotations[i].end());
                     project->setDirty();
                     annotation_history.update(annotations);
                 }
+                if (thumbnails) {
+                    show_thumbnail_preview(*thumbnails, video_file->getDuration());
+                }
                 ImGui::PopID();
 
                 if (ImGui::BeginPopupContextItem(class_id_label.c_str())) {
@@ -522,7 +1139,29 @@ int main(int argc, char* argv[]) {
         }
 
         videoFileDialog.Display();
-        if (videoFileDialog.HasSelected() || !open_recent_video.empty()) {
+        bool is_video_selected = videoFileDialog.HasSelected() || !open_recent_video.empty();
+
+        // spans drawn while the hash is still being computed can't be stored yet, so they would
+        // be lost with the video
+        if (is_video_selected && !confirm_video_switch && video_file && !can_save &&
+            std::any_of(annotations.begin(), annotations.end(),
+                        [](const auto& spans) { return !spans.empty(); }))
+        {
+            confirm_video_switch = true;
+        }
+        int do_switch = CONFIRM_UNKNOWN;
+        if (is_video_selected && confirm_video_switch) {
+            do_switch = getConfirmation("Are you sure?##SwitchVideo", "The spans of this video can't be stored until its hash has been computed. Do you really want to discard them and open another video?", fontawesome_large);
+        }
+        if (do_switch == CONFIRM_NO) {
+            confirm_video_switch = false;
+            is_video_selected = false;
+            open_recent_video = {};
+            videoFileDialog.ClearSelected();
+        }
+
+        if (is_video_selected && (!confirm_video_switch || do_switch == CONFIRM_YES)) {
+            confirm_video_switch = false;
             std::string video_path = open_recent_video;
             if (video_path.empty()) {
                 video_path = videoFileDialog.GetSelected().string();
@@ -531,42 +1170,94 @@ int main(int argc, char* argv[]) {
 
             videoFileDialog.ClearSelected();
 
-            video_file = just_annotate::VideoFile::open(video_path);
+            // metadata from a library scan saves probing the file again
+            MediaInfo media_info;
+            bool is_indexed = media_index->getInfo(video_path, media_info);
+
+            just_annotate::VideoOptions video_options;
+            video_options.duration = media_info.duration;
+            video_options.gl_output = config_state.gl_output;
+            // queued videos are usually prerolled already
+            just_annotate::VideoFile::Ptr prerolled;
+            if (video_queue) {
+                prerolled = video_queue->take(video_path);
+            }
+            video_file = prerolled ? prerolled
+                                   : just_annotate::VideoFile::open(video_path, video_options);
+            thumbnails.reset();
             if (!video_file) {
                 printf("Failed to open video file: %s\n", video_path.c_str());
                 ImGui::OpenPopup("Error##LoadVideo");
             }
             else {
+                video_file->setFrameCacheSize(static_cast<size_t>(config_state.frame_cache_mb) << 20);
+                video_file->setFrameMemory(static_cast<size_t>(config_state.frame_memory_mb) << 20);
+                video_file->setNativeResolution(native_resolution);
+                thumbnails = just_annotate::ThumbnailStrip::open(video_path);
                 filepath = video_path;
                 config_state.addRecentVideo(video_path);
                 saveConfig(config_state);
-                std::string hash = get_file_hash(video_file->getPath());
-                if (!hash.empty()) {
 
-                    if (project->hasFile()) {
-                        for (size_t i = 0; i < annotation_classes.size(); i++) {
-                            if(!project->setAnnotations({annotation_classes[i].id, annotations[i]})) {
-                                spdlog::error("Failed to set annotations.");
-                            }
-                            annotations[i].clear();
+                if (project->hasFile() && can_save) {
+                    for (size_t i = 0; i < annotation_classes.size(); i++) {
+                        if(!project->setAnnotations({annotation_classes[i].id, annotations[i]})) {
+                            spdlog::error("Failed to set annotations.");
                         }
                     }
+                }
+                for (auto& spans: annotations) {
+                    spans.clear();
+                }
+                annotation_history.initialize(annotations);
+
+                // the video plays right away, spans are bound to the project by the quick
+                // fingerprint if it is already known, and confirmed once the full hash arrives
+                project->clearFile();
+                video_hashes.clear();
+                video_fingerprint = is_indexed && !media_info.fingerprint.empty() ?
+                    media_info.fingerprint : fingerprint(video_file->getPath());
+                fingerprint_spans.clear();
+                if (project->setFileByFingerprint(video_fingerprint)) {
+                    load_file_annotations(*project, annotation_classes, annotations,
+                                          annotation_history);
+                    fingerprint_spans = annotations;
+                }
+                hash_cancelled = false;
+                hash_worker.start(video_file->getPath(),
+                                  required_hash_algorithms(*project, config_state.hash_algorithm));
+            }
+        }
 
-                    std::filesystem::path fs_path(video_path);
-                    project->setFile(fs_path.filename().string(), hash);
-                    auto saved_file_annotations = project->getAnnotations();
-                    for (const auto& saved_annotations: saved_file_annotations) {
-                        for (size_t i = 0; i < annotation_classes.size(); i++) {
-                            if (annotation_classes[i].id == saved_annotations.id) {
-                                annotations[i] = saved_annotations.spans;
-                            }
-                        }
-                    }
-                    annotation_history.initialize(annotations);
+        searchRootDialog.Display();
+        if (searchRootDialog.HasSelected()) {
+            config_state.addSearchRoot(searchRootDialog.GetSelected().string());
+            saveConfig(config_state);
+            searchRootDialog.ClearSelected();
+
+            file_locator.start(project->getMissingFiles(), config_state.search_roots);
+        }
+
+        for (auto dialog: {&queueDirectoryDialog, &queueListDialog}) {
+            dialog->Display();
+            if (dialog->HasSelected()) {
+                video_queue = just_annotate::VideoQueue::open(dialog->GetSelected().string(),
+                                                              hash_cache);
+                dialog->ClearSelected();
+                if (video_queue) {
+                    open_recent_video = video_queue->getEntry(0);
+                }
+                else {
+                    ImGui::OpenPopup("Error##LoadQueue");
                 }
             }
         }
 
+        libraryDialog.Display();
+        if (libraryDialog.HasSelected()) {
+            library_roots.push_back(libraryDialog.GetSelected().string());
+            libraryDialog.ClearSelected();
+        }
+
         openProjectDialog.Display();
         if (openProjectDialog.HasSelected() || !open_recent_path.empty()) {
             std::string open_path = open_recent_path;
@@ -604,21 +1295,44 @@ int main(int argc, char* argv[]) {
                         annotationClassDialog.AddExisting(annotation_class.id);
                     }
 
+                    // videos that moved since the project was saved are searched for in the
+                    // background, and the first one that is still in place is opened right away
+                    file_locator.cancel();
+                    auto missing_files = project->getMissingFiles();
+                    if (!missing_files.empty() && !config_state.search_roots.empty()) {
+                        file_locator.start(missing_files, config_state.search_roots);
+                    }
+                    if (!video_file) {
+                        open_recent_video = next_located_file(*project, true);
+                    }
+
+                    fingerprint_spans.clear();
                     if (video_file) {
-                        std::string hash = get_file_hash(video_file->getPath());
-                        if (!hash.empty()) {
-                            std::filesystem::path fs_path(video_file->getPath());
-                            project->setFile(fs_path.filename().string(), hash);
-                            auto saved_file_annotations = project->getAnnotations();
-                            for (const auto& saved_annotations: saved_file_annotations) {
-                                for (size_t i = 0; i < annotation_classes.size(); i++) {
-                                    if (annotation_classes[i].id == saved_annotations.id) {
-                                        annotations[i] = saved_annotations.spans;
-                                    }
-                                }
+                        annotation_history.initialize(annotations);
+                        auto algorithms =
+                          required_hash_algorithms(*project, config_state.hash_algorithm);
+                        if (has_hashes(video_hashes, algorithms)) {
+                            bind_file_annotations(*project, video_file->getPath(), video_hashes,
+                                                  config_state.hash_algorithm, video_fingerprint,
+                                                  annotation_classes, annotations,
+                                                  annotation_history);
+                        }
+                        else {
+                            if (project->setFileByFingerprint(video_fingerprint)) {
+                                load_file_annotations(*project, annotation_classes, annotations,
+                                                      annotation_history);
+                                fingerprint_spans = annotations;
+                            }
+                            // keep a job that is already hashing this video with the right algorithms
+                            auto worker_algorithms = hash_worker.getAlgorithms();
+                            if (!hash_worker.isBusy() ||
+                                !std::includes(worker_algorithms.begin(), worker_algorithms.end(),
+                                               algorithms.begin(), algorithms.end()))
+                            {
+                                hash_cancelled = false;
+                                hash_worker.start(video_file->getPath(), algorithms);
                             }
                         }
-                        annotation_history.initialize(annotations);
                     }
                 }
             }
@@ -663,12 +1377,26 @@ int main(int argc, char* argv[]) {
                 annotation_history.clear();
                 annotationClassDialog.ClearExisting();
                 project = std::make_shared<AnnotationStore>();
+                fingerprint_spans.clear();
+                // the search was for the videos of the closed project
+                file_locator.cancel();
 
                 if (video_file) {
-                    std::string hash = get_file_hash(video_file->getPath());
-                    if (!hash.empty()) {
-                        std::filesystem::path fs_path(video_file->getPath());
-                        project->setFile(fs_path.filename().string(), hash);
+                    auto algorithms = required_hash_algorithms(*project, config_state.hash_algorithm);
+                    if (has_hashes(video_hashes, algorithms)) {
+                        bind_file_annotations(*project, video_file->getPath(), video_hashes,
+                                              config_state.hash_algorithm, video_fingerprint,
+                                              annotation_classes, annotations, annotation_history);
+                    }
+                    else {
+                        auto worker_algorithms = hash_worker.getAlgorithms();
+                        if (!hash_worker.isBusy() ||
+                            !std::includes(worker_algorithms.begin(), worker_algorithms.end(),
+                                           algorithms.begin(), algorithms.end()))
+                        {
+                            hash_cancelled = false;
+                            hash_worker.start(video_file->getPath(), algorithms);
+                        }
                     }
                 }
             }
@@ -689,6 +1417,142 @@ int main(int argc, char* argv[]) {
             edit_annotation_class = -1;
         }
 
+        if (show_hash_cache) {
+            show_hash_cache = false;
+            hashCacheDialog.Open(hash_cache);
+        }
+        hashCacheDialog.Display();
+
+        if (show_statistics) {
+            ImGui::SetNextWindowSize(ImVec2(280, 0), ImGuiCond_FirstUseEver);
+            if (ImGui::Begin("Statistics", &show_statistics)) {
+                ImGui::Text("UI: %.0f fps, %.0f%% asleep", ui_fps, ui_asleep_percent);
+                ImGui::Separator();
+
+                if (video_file) {
+                    auto open_stats = just_annotate::VideoFile::getOpenStats();
+                    ImGui::Text("Open last: %.1f ms (%s)", open_stats.last_ms,
+                                open_stats.last_pooled ? "pooled" : "cold");
+                    ImGui::Text("Open cold: %.1f ms mean of %zu", open_stats.cold_mean_ms,
+                                open_stats.cold_opens);
+                    ImGui::Text("Open pooled: %.1f ms mean of %zu", open_stats.pooled_mean_ms,
+                                open_stats.pooled_opens);
+                    ImGui::Separator();
+
+                    auto stats = video_file->getSeekStats();
+                    ImGui::Text("Pipeline seeks: %zu", stats.pipeline_seeks);
+                    ImGui::Text("Frame cache hits: %zu", stats.cache_hits);
+                    ImGui::Text("Coalesced commands: %zu", stats.coalesced);
+                    ImGui::Separator();
+                    ImGui::Text("Seek latency last: %.1f ms", stats.last_ms);
+                    ImGui::Text("Seek latency mean: %.1f ms", stats.mean_ms);
+                    ImGui::Text("Seek latency max: %.1f ms", stats.max_ms);
+                    ImGui::Separator();
+
+                    // switching resets the upload times so that both methods can be compared
+                    bool use_pixel_buffers = video_file->isPixelBufferUpload();
+                    if (ImGui::Checkbox("Pixel buffer upload", &use_pixel_buffers)) {
+                        video_file->setPixelBufferUpload(use_pixel_buffers);
+                    }
+                    auto upload_stats = video_file->getUploadStats();
+                    if (video_file->isGLOutput()) {
+                        ImGui::TextDisabled("GL output, frames aren't copied");
+                    }
+                    ImGui::Text("Uploaded frames: %zu", upload_stats.frames);
+                    ImGui::Text("Dropped frames: %zu", upload_stats.dropped);
+                    ImGui::Text("Upload last: %.2f ms", upload_stats.last_ms);
+                    ImGui::Text("Upload mean: %.2f ms", upload_stats.mean_ms);
+                    ImGui::Text("Upload max: %.2f ms", upload_stats.max_ms);
+                    ImGui::Separator();
+
+                    auto present_stats = video_file->getPresentStats();
+                    ImGui::Text("Presented frames: %zu", present_stats.presented);
+                    ImGui::Text("Skipped frames: %zu", present_stats.dropped);
+                    ImGui::Text("Late frames: %zu", present_stats.late);
+                    ImGui::Text("Swap delay: %.2f ms", present_stats.delay_ms);
+                    ImGui::Text("Latency last: %.2f ms", present_stats.latency_last_ms);
+                    ImGui::Text("Latency mean: %.2f ms", present_stats.latency_mean_ms);
+                    ImGui::Text("Latency max: %.2f ms", present_stats.latency_max_ms);
+                    ImGui::Separator();
+
+                    auto memory_stats = video_file->getFrameMemoryStats();
+                    ImGui::Text("Retained frames: %zu, %.1f of %.0f MB",
+                                memory_stats.retained_frames,
+                                memory_stats.retained_bytes / 1048576.0,
+                                memory_stats.budget_bytes / 1048576.0);
+                    ImGui::Text("Cached frames: %zu, %.1f of %.0f MB", memory_stats.cache_frames,
+                                memory_stats.cache_bytes / 1048576.0,
+                                memory_stats.cache_max_bytes / 1048576.0);
+                    // the displayed frame can be both retained and cached, an upper bound
+                    ImGui::Text("Frame memory: up to %.1f MB",
+                                (memory_stats.retained_bytes + memory_stats.cache_bytes) /
+                                    1048576.0);
+                    ImGui::Text("Frame allocations: %zu", memory_stats.allocations);
+                    ImGui::Separator();
+
+                    auto flags = ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit;
+                    if (ImGui::BeginTable("Resolutions", 4, flags)) {
+                        ImGui::TableSetupColumn("Size");
+                        ImGui::TableSetupColumn("Decode fps");
+                        ImGui::TableSetupColumn("Convert ms");
+                        ImGui::TableSetupColumn("Upload ms");
+                        ImGui::TableHeadersRow();
+                        for (const auto& resolution: video_file->getResolutionStats()) {
+                            ImGui::TableNextRow();
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%dx%d", resolution.width, resolution.height);
+                            ImGui::TableNextColumn();
+                            if (resolution.playing_seconds > 0) {
+                                ImGui::Text("%.1f", resolution.playing_frames /
+                                                    resolution.playing_seconds);
+                            }
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%.2f", resolution.convert_ms / resolution.frames);
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%.2f", resolution.upload_ms / resolution.frames);
+                        }
+                        ImGui::EndTable();
+                    }
+                    ImGui::Separator();
+
+                    // a fixed profile is measured in every situation, e.g. scrubbing at full quality
+                    const char* profile_names[] = {"Auto", "Quality", "Playback", "Scrub"};
+                    int profile = static_cast<int>(video_file->getDecoderProfile());
+                    if (ImGui::Combo("Decoder profile", &profile, profile_names,
+                                     IM_ARRAYSIZE(profile_names)))
+                    {
+                        video_file->setDecoderProfile(
+                          static_cast<just_annotate::DecoderProfile>(profile));
+                    }
+                    auto active_profile = static_cast<int>(video_file->getActiveDecoderProfile());
+                    if (ImGui::BeginTable("Decoder profiles", 3, flags)) {
+                        ImGui::TableSetupColumn("Profile");
+                        ImGui::TableSetupColumn("Frames");
+                        ImGui::TableSetupColumn("Decode fps");
+                        ImGui::TableHeadersRow();
+                        for (const auto& decoder: video_file->getDecoderStats()) {
+                            int index = static_cast<int>(decoder.profile);
+                            ImGui::TableNextRow();
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%s%s", profile_names[index],
+                                        index == active_profile ? " *" : "");
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%zu", decoder.frames);
+                            ImGui::TableNextColumn();
+                            if (decoder.busy_seconds > 0) {
+                                ImGui::Text("%.1f", decoder.frames / decoder.busy_seconds);
+                            }
+                        }
+                        ImGui::EndTable();
+                    }
+                }
+                else {
+                    ImGui::TextDisabled("No video open.");
+                }
+            }
+            ImGui::End();
+        }
+
         annotationClassDialog.Display(fontawesome_large);
         if (annotationClassDialog.HasAnnotationClass()) {
             if (!project->addAnnotationClass(annotationClassDialog.GetAnnotationClass())) {
@@ -735,7 +1599,9 @@ int main(int argc, char* argv[]) {
         }
 
         displayErrorMessage("Error##LoadVideo", "Failed to open video file.", fontawesome_large);
+        displayErrorMessage("Error##LoadQueue", "No videos found to queue.", fontawesome_large);
         displayErrorMessage("Error##Hash", "Failed to get hash of video file.", fontawesome_large);
+        displayErrorMessage("Warning##Fingerprint", "The quick fingerprint of this video matched a different file in the project. Its spans have been replaced by the ones of this video after checking the full hash, keeping the edits made meanwhile.", fontawesome_large);
         displayErrorMessage("Error##OpenProject", "Failed to open project.", fontawesome_large);
         displayErrorMessage("Error##SaveProject", "Failed to save project.", fontawesome_large);
         displayErrorMessage("Error##AddAnnotationClass", "Failed to add annotation class.", fontawesome_large);
@@ -747,6 +1613,16 @@ int main(int argc, char* argv[]) {
         if (video_file) {
             video_file->update();
         }
+        if (thumbnails) {
+            thumbnails->update();
+        }
+        if (video_queue) {
+            just_annotate::VideoOptions queue_options;
+            queue_options.gl_output = config_state.gl_output;
+            video_queue->update(queue_options,
+                                required_hash_algorithms(*project, config_state.hash_algorithm),
+                                !hash_worker.isBusy());
+        }
 
         // Rendering
         ImGui::Render();
@@ -763,8 +1639,21 @@ int main(int argc, char* argv[]) {
 
         glfwMakeContextCurrent(window);
         glfwSwapBuffers(window);
+        if (video_file) {
+            video_file->presented();
+        }
 
-        if (seek_position != video_position) {
+        if (is_seeking) {
+            if (seek_position != video_position) {
+                video_file->scrub(seek_position);
+                scrub_position = seek_position;
+            }
+        }
+        else if (scrub_position >= 0) {
+            video_file->seek(scrub_position);
+            scrub_position = -1.0;
+        }
+        else if (seek_position != video_position) {
             video_file->seek(seek_position);
         }
         if (is_seeking && !video_file->isPaused()) {
@@ -800,6 +1689,10 @@ int main(int argc, char* argv[]) {
     }
 
     // Cleanup
+    video_queue.reset();
+    thumbnails.reset();
+    video_file.reset();
+    just_annotate::VideoFile::clearPool();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
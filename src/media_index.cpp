@@ -0,0 +1,428 @@
+#include <just_annotate/media_index.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+
+#include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
+#include <just_annotate/config_store.h>
+#include <just_annotate/hash.h>
+#include <just_annotate/ui_wake.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+const std::set<std::string> VIDEO_EXTENSIONS = {".mp4", ".ts"};
+
+void to_json(json& j, const MediaInfo& m) {
+    j = json{{"path", m.path}, {"size", m.size}, {"mtime", m.mtime}, {"inode", m.inode},
+             {"duration", m.duration}, {"width", m.width}, {"height", m.height},
+             {"frame_rate", m.frame_rate}, {"codec", m.codec}, {"fingerprint", m.fingerprint}};
+}
+
+void from_json(const json& j, MediaInfo& m) {
+    j.at("path").get_to(m.path);
+    j.at("size").get_to(m.size);
+    j.at("mtime").get_to(m.mtime);
+    j.at("inode").get_to(m.inode);
+    j.at("duration").get_to(m.duration);
+    j.at("width").get_to(m.width);
+    j.at("height").get_to(m.height);
+    j.at("frame_rate").get_to(m.frame_rate);
+    j.at("codec").get_to(m.codec);
+    j.at("fingerprint").get_to(m.fingerprint);
+}
+
+bool MediaInfo::isStale() const {
+    HashCacheEntry current;
+    if (!statFile(path, current)) {
+        return true;
+    }
+
+    return current.size != size || current.mtime != mtime || current.inode != inode;
+}
+
+MediaIndex::Ptr MediaIndex::open() {
+    return open(findConfigDir() + "/.just_annotate_media_index");
+}
+
+MediaIndex::Ptr MediaIndex::open(const std::string& path) {
+    auto index = std::make_shared<MediaIndex>();
+    index->path_ = path;
+
+    if (!fs::exists(path)) {
+        return index;
+    }
+
+    std::ifstream infile(path);
+    if (infile.is_open()) {
+        try {
+            json j;
+            infile >> j;
+            infile.close();
+
+            std::vector<MediaInfo> entries;
+            j.at("entries").get_to(entries);
+            for (const auto& entry: entries) {
+                index->entries_[entry.path] = entry;
+            }
+            if (j.contains("pending_roots")) {
+                j.at("pending_roots").get_to(index->pending_roots_);
+            }
+        }
+        catch (json::exception& e) {
+            spdlog::warn("Discarding unreadable media index {}: {}", path, e.what());
+        }
+        return index;
+    }
+
+    spdlog::warn("Failed to open file: {}", path);
+    return index;
+}
+
+bool MediaIndex::save() {
+    std::lock_guard<std::mutex> save_lock(save_mutex_);
+
+    json j;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<MediaInfo> entries;
+        for (const auto& entry: entries_) {
+            entries.push_back(entry.second);
+        }
+        j["entries"] = entries;
+        j["pending_roots"] = pending_roots_;
+    }
+
+    // write to a temporary file first so that a crash never leaves a truncated index behind
+    std::string tmp_path = path_ + ".tmp";
+    std::ofstream outfile(tmp_path);
+    if (outfile.is_open()) {
+        outfile << std::setw(4) << j << std::endl;
+        outfile.close();
+
+        std::error_code ec;
+        fs::rename(tmp_path, path_, ec);
+        if (!ec) {
+            return true;
+        }
+    }
+
+    spdlog::error("Failed to save media index to: {}", path_);
+    return false;
+}
+
+bool MediaIndex::getInfo(const std::string& path, MediaInfo& info) const {
+    HashCacheEntry current;
+    if (!statFile(path, current)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry_it = entries_.find(normalizePath(path));
+    if (entry_it == entries_.end()) {
+        return false;
+    }
+
+    const auto& entry = entry_it->second;
+    if (entry.size != current.size || entry.mtime != current.mtime ||
+        entry.inode != current.inode)
+    {
+        return false;
+    }
+
+    info = entry;
+    return true;
+}
+
+void MediaIndex::setInfo(const MediaInfo& info) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[info.path] = info;
+}
+
+size_t MediaIndex::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+std::set<std::string> MediaIndex::getPendingRoots() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_roots_;
+}
+
+void MediaIndex::addPendingRoot(const std::string& root) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_roots_.insert(root);
+}
+
+void MediaIndex::removePendingRoot(const std::string& root) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_roots_.erase(root);
+}
+
+LibraryScanner::LibraryScanner(const MediaIndex::Ptr& media_index, const HashCache::Ptr& hash_cache)
+  : media_index_(media_index), hash_cache_(hash_cache)
+{
+}
+
+LibraryScanner::~LibraryScanner() {
+    cancel();
+    join();
+}
+
+void LibraryScanner::start(const std::string& root, const std::set<std::string>& algorithms,
+                           unsigned int num_threads)
+{
+    cancel();
+    join();
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        root_ = normalizePath(root);
+        queue_.clear();
+    }
+    cancel_ = false;
+    finished_ = false;
+    total_ = 0;
+    completed_ = 0;
+    busy_ = true;
+    thread_ = std::thread(&LibraryScanner::run, this, normalizePath(root), algorithms, num_threads);
+}
+
+void LibraryScanner::cancel() {
+    cancel_ = true;
+}
+
+void LibraryScanner::join() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool LibraryScanner::isBusy() const {
+    return busy_;
+}
+
+std::string LibraryScanner::getRoot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return root_;
+}
+
+size_t LibraryScanner::getTotal() const {
+    return total_;
+}
+
+size_t LibraryScanner::getCompleted() const {
+    return completed_;
+}
+
+bool LibraryScanner::poll() {
+    return finished_.exchange(false);
+}
+
+void LibraryScanner::run(std::string root, std::set<std::string> algorithms,
+                         unsigned int num_threads)
+{
+    gst_pb_utils_init();
+    media_index_->addPendingRoot(root);
+    media_index_->save();
+
+    // collect the videos which aren't fully indexed yet
+    std::error_code ec;
+    auto options = fs::directory_options::skip_permission_denied;
+    for (auto it = fs::recursive_directory_iterator(root, options, ec);
+         !ec && it != fs::recursive_directory_iterator() && !cancel_; it.increment(ec))
+    {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+
+        std::string extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        if (VIDEO_EXTENSIONS.count(extension) == 0) {
+            continue;
+        }
+
+        std::string path = it->path().string();
+        MediaInfo info;
+        bool is_indexed = media_index_->getInfo(path, info);
+        for (const auto& algorithm: algorithms) {
+            is_indexed = is_indexed && !hash_cache_->getHash(path, algorithm).empty();
+        }
+        if (is_indexed) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(path);
+        total_++;
+    }
+    if (ec) {
+        spdlog::error("Failed to scan {}: {}", root, ec.message());
+    }
+    spdlog::info("library scan of {}: {} videos to index", root, total_.load());
+
+    last_save_ = std::chrono::steady_clock::now();
+
+    auto index_files = [this, &algorithms]() {
+        GError* error = nullptr;
+        GstDiscoverer* discoverer = gst_discoverer_new(10 * GST_SECOND, &error);
+        if (!discoverer) {
+            spdlog::error("Failed to create discoverer: {}", error ? error->message : "unknown");
+            g_clear_error(&error);
+            return;
+        }
+
+        while (!cancel_) {
+            std::string path;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (queue_.empty()) {
+                    break;
+                }
+                path = queue_.front();
+                queue_.pop_front();
+            }
+
+            indexFile(discoverer, path, algorithms);
+            completed_++;
+            saveThrottled();
+        }
+
+        g_object_unref(discoverer);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < num_threads; i++) {
+        threads.emplace_back(index_files);
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    if (!cancel_) {
+        media_index_->removePendingRoot(root);
+        finished_ = true;
+    }
+    media_index_->save();
+    hash_cache_->save();
+
+    busy_ = false;
+    just_annotate::wakeUi();
+}
+
+void LibraryScanner::indexFile(GstDiscoverer* discoverer, const std::string& path,
+                               const std::set<std::string>& algorithms)
+{
+    // entries without a duration were stored by scans that still kept failed discoveries
+    MediaInfo info;
+    if (!media_index_->getInfo(path, info) || info.duration <= 0) {
+        HashCacheEntry current;
+        if (!statFile(path, current)) {
+            return;
+        }
+
+        info = {};
+        info.path = normalizePath(path);
+        info.size = current.size;
+        info.mtime = current.mtime;
+        info.inode = current.inode;
+
+        GError* error = nullptr;
+        gchar* uri = gst_filename_to_uri(path.c_str(), &error);
+        GstDiscovererInfo* discovered = uri ? gst_discoverer_discover_uri(discoverer, uri, &error)
+                                            : nullptr;
+        g_free(uri);
+
+        bool is_discovered = discovered &&
+                             gst_discoverer_info_get_result(discovered) == GST_DISCOVERER_OK;
+        if (is_discovered) {
+            info.duration = gst_discoverer_info_get_duration(discovered) * 1e-9;
+
+            GList* streams = gst_discoverer_info_get_video_streams(discovered);
+            if (streams) {
+                auto video_info = GST_DISCOVERER_VIDEO_INFO(streams->data);
+                info.width = gst_discoverer_video_info_get_width(video_info);
+                info.height = gst_discoverer_video_info_get_height(video_info);
+                guint num = gst_discoverer_video_info_get_framerate_num(video_info);
+                guint denom = gst_discoverer_video_info_get_framerate_denom(video_info);
+                if (denom > 0) {
+                    info.frame_rate = static_cast<double>(num) / denom;
+                }
+
+                auto stream_info = GST_DISCOVERER_STREAM_INFO(video_info);
+                GstCaps* caps = gst_discoverer_stream_info_get_caps(stream_info);
+                if (caps) {
+                    gchar* description = gst_pb_utils_get_codec_description(caps);
+                    if (description) {
+                        info.codec = description;
+                        g_free(description);
+                    }
+                    gst_caps_unref(caps);
+                }
+            }
+            gst_discoverer_stream_info_list_free(streams);
+        }
+        else {
+            spdlog::warn("Failed to discover {}: {}", path, error ? error->message : "unknown");
+        }
+        g_clear_error(&error);
+        if (discovered) {
+            gst_discoverer_info_unref(discovered);
+        }
+
+        // a failed or timed out discovery is retried by the next scan rather than kept as a
+        // video without a duration
+        if (is_discovered) {
+            info.fingerprint = fingerprint(path);
+            media_index_->setInfo(info);
+        }
+    }
+
+    for (const auto& algorithm: algorithms) {
+        if (cancel_) {
+            return;
+        }
+
+        if (!hash_cache_->getHash(path, algorithm).empty()) {
+            continue;
+        }
+
+        HashCacheEntry before;
+        if (!statFile(path, before)) {
+            return;
+        }
+
+        // each file is hashed on a single thread, the pool already keeps the cores busy
+        std::string hash = algorithm == HASH_SHA256_TREE ?
+            sha256Tree(path, [this](uint64_t, uint64_t) { return !cancel_; }, 1) :
+            hashFile(path, algorithm, [this](uint64_t, uint64_t) { return !cancel_; });
+        if (!hash.empty()) {
+            hash_cache_->setHash(path, before, hash, algorithm);
+        }
+    }
+}
+
+void LibraryScanner::saveThrottled() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_save_ < std::chrono::seconds(5)) {
+            return;
+        }
+        last_save_ = now;
+    }
+
+    media_index_->save();
+    hash_cache_->save();
+}
@@ -0,0 +1,403 @@
+#include <just_annotate/thumbnail_strip.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <GL/gl.h>
+#include <gst/gst.h>
+#include <gst/app/app.h>
+#include <gst/video/video.h>
+#include <just_annotate/config_store.h>
+#include <just_annotate/hash.h>
+#include <just_annotate/ui_wake.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+namespace just_annotate {
+
+// roughly one thumbnail every few seconds, up to what fits a wide timeline
+const double MIN_THUMBNAIL_INTERVAL = 2.0;
+const size_t MAX_THUMBNAILS = 240;
+const int ATLAS_COLUMNS = 16;
+// partially decoded atlases are uploaded at most this often
+const auto UPLOAD_INTERVAL = std::chrono::milliseconds(250);
+
+void lower_thread_priority() {
+#ifdef __linux__
+    // the nice value applies to the calling thread only on Linux
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19) != 0) {
+        spdlog::debug("Failed to lower thread priority.");
+    }
+#endif
+}
+
+// runs on the thread that posted the message, which lets the decoder's streaming threads lower
+// their own priority as they start
+GstBusSyncReply thumbnail_bus_sync(GstBus* /* bus */, GstMessage* msg, gpointer /* data */) {
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        gst_message_parse_stream_status(msg, &type, nullptr);
+        if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+            lower_thread_priority();
+        }
+    }
+
+    // only errors are read from the bus, everything else would just pile up
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        return GST_BUS_PASS;
+    }
+    return GST_BUS_DROP;
+}
+
+ThumbnailStrip::~ThumbnailStrip() {
+    cancel_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    if (texture_id_ != 0) {
+        glDeleteTextures(1, &texture_id_);
+    }
+}
+
+ThumbnailStrip::Ptr ThumbnailStrip::open(const std::string& path) {
+    auto strip = std::shared_ptr<ThumbnailStrip>(new ThumbnailStrip());
+    strip->path_ = path;
+    strip->thread_ = std::thread(&ThumbnailStrip::run, strip.get());
+    return strip;
+}
+
+void ThumbnailStrip::update() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!atlas_changed_) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (!complete_ && now - last_upload_ < UPLOAD_INTERVAL) {
+        return;
+    }
+    last_upload_ = now;
+    atlas_changed_ = false;
+
+    if (texture_id_ == 0) {
+        glGenTextures(1, &texture_id_);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture_id_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, columns_ * THUMBNAIL_WIDTH, rows_ * THUMBNAIL_HEIGHT,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, atlas_.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+uint32_t ThumbnailStrip::getTextureId() const {
+    return texture_id_;
+}
+
+bool ThumbnailStrip::isComplete() const {
+    return complete_;
+}
+
+size_t ThumbnailStrip::getCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
+bool ThumbnailStrip::find(double time, Thumbnail& thumbnail) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ == 0 || duration_ <= 0 || texture_id_ == 0) {
+        return false;
+    }
+
+    // thumbnails are taken from the middle of equal intervals of the video
+    double interval = duration_ / count_;
+    int center = std::clamp(static_cast<int>(time / interval), 0, static_cast<int>(count_) - 1);
+    for (int offset = 0; offset < static_cast<int>(count_); offset++) {
+        for (int index: {center - offset, center + offset}) {
+            if (index < 0 || index >= static_cast<int>(count_) || !decoded_[index]) {
+                continue;
+            }
+
+            int column = index % columns_;
+            int row = index / columns_;
+            thumbnail.time = (index + 0.5) * interval;
+            thumbnail.u0 = static_cast<float>(column) / columns_;
+            thumbnail.v0 = static_cast<float>(row) / rows_;
+            thumbnail.u1 = static_cast<float>(column + 1) / columns_;
+            thumbnail.v1 = static_cast<float>(row + 1) / rows_;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThumbnailStrip::run() {
+    lower_thread_priority();
+
+    std::string video_fingerprint = fingerprint(path_);
+    if (video_fingerprint.empty()) {
+        return;
+    }
+    cache_path_ = findConfigDir() + "/.just_annotate_thumbnails/" + video_fingerprint;
+
+    if (load()) {
+        spdlog::info("loaded {} thumbnails of {}", getCount(), path_);
+        complete_ = true;
+        wakeUi();
+        return;
+    }
+
+    if (build()) {
+        spdlog::info("decoded {} thumbnails of {}", getCount(), path_);
+        complete_ = true;
+        wakeUi();
+        save();
+    }
+}
+
+bool ThumbnailStrip::load() {
+    std::ifstream meta_file(cache_path_ + ".json");
+    if (!meta_file.is_open()) {
+        return false;
+    }
+
+    size_t count = 0;
+    int columns = 0;
+    double duration = 0;
+    try {
+        json j;
+        meta_file >> j;
+        if (j.at("width").get<int>() != THUMBNAIL_WIDTH ||
+            j.at("height").get<int>() != THUMBNAIL_HEIGHT)
+        {
+            return false;
+        }
+        j.at("count").get_to(count);
+        j.at("columns").get_to(columns);
+        j.at("duration").get_to(duration);
+    }
+    catch (json::exception& e) {
+        spdlog::warn("Discarding unreadable thumbnails {}: {}", cache_path_, e.what());
+        return false;
+    }
+    if (count == 0 || columns <= 0) {
+        return false;
+    }
+
+    int rows = (static_cast<int>(count) + columns - 1) / columns;
+    std::vector<uint8_t> atlas(static_cast<size_t>(columns) * THUMBNAIL_WIDTH * rows *
+                               THUMBNAIL_HEIGHT * 4);
+    std::ifstream atlas_file(cache_path_ + ".rgba", std::ios::binary);
+    if (!atlas_file.read(reinterpret_cast<char*>(atlas.data()), atlas.size())) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    duration_ = duration;
+    count_ = count;
+    columns_ = columns;
+    rows_ = rows;
+    atlas_ = std::move(atlas);
+    decoded_.assign(count, true);
+    atlas_changed_ = true;
+    return true;
+}
+
+bool ThumbnailStrip::build() {
+    // a keyframe seek is enough for a thumbnail, and scaling down before conversion keeps the
+    // per-frame cost small
+    std::string config = "uridecodebin uri=file://" + path_;
+    config += " ! videoscale ! videoconvert ! video/x-raw,format=RGBA,width=";
+    config += std::to_string(THUMBNAIL_WIDTH) + ",height=" + std::to_string(THUMBNAIL_HEIGHT);
+    config += ",pixel-aspect-ratio=1/1 ! appsink name=thumbsink sync=0 max-buffers=1";
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(config.c_str(), &error);
+    if (!pipeline) {
+        spdlog::error("Failed to create thumbnail pipeline: {}",
+                      error ? error->message : "unknown");
+        g_clear_error(&error);
+        return false;
+    }
+    g_clear_error(&error);
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "thumbsink");
+
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_set_sync_handler(bus, thumbnail_bus_sync, nullptr, nullptr);
+
+    bool complete = false;
+    bool failed = false;
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    gint64 duration_ns = GST_CLOCK_TIME_NONE;
+    if (gst_element_get_state(pipeline, nullptr, nullptr, 10 * GST_SECOND) ==
+            GST_STATE_CHANGE_FAILURE ||
+        !gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration_ns) || duration_ns <= 0)
+    {
+        spdlog::warn("Failed to preroll thumbnail pipeline for: {}", path_);
+    }
+    else {
+        double duration = duration_ns * 1e-9;
+        size_t count = std::clamp(static_cast<size_t>(duration / MIN_THUMBNAIL_INTERVAL),
+                                  size_t(1), MAX_THUMBNAILS);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            duration_ = duration;
+            count_ = count;
+            columns_ = static_cast<int>(std::min<size_t>(count, ATLAS_COLUMNS));
+            rows_ = (static_cast<int>(count) + columns_ - 1) / columns_;
+            atlas_.assign(static_cast<size_t>(columns_) * THUMBNAIL_WIDTH * rows_ *
+                          THUMBNAIL_HEIGHT * 4, 0);
+            decoded_.assign(count, false);
+        }
+
+        // coarse to fine, so that the whole timeline is covered early and then filled in
+        size_t step = 1;
+        while (step * 2 < count) {
+            step *= 2;
+        }
+        size_t decoded = 0;
+        for (; step > 0 && !cancel_ && !failed; step /= 2) {
+            for (size_t i = 0; i < count && !cancel_ && !failed; i += step) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (decoded_[i]) {
+                        continue;
+                    }
+                }
+
+                GstMessage* message = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+                if (message) {
+                    GError* gerror = nullptr;
+                    gst_message_parse_error(message, &gerror, nullptr);
+                    spdlog::warn("Failed to decode thumbnails of {}: {}", path_, gerror->message);
+                    g_clear_error(&gerror);
+                    gst_message_unref(message);
+                    failed = true;
+                    break;
+                }
+
+                gint64 time = static_cast<gint64>((i + 0.5) * duration / count * GST_SECOND);
+                if (!gst_element_seek_simple(pipeline, GST_FORMAT_TIME,
+                                             GstSeekFlags(GST_SEEK_FLAG_FLUSH |
+                                                          GST_SEEK_FLAG_KEY_UNIT |
+                                                          GST_SEEK_FLAG_SNAP_NEAREST), time))
+                {
+                    continue;
+                }
+
+                GstSample* sample = gst_app_sink_try_pull_preroll(GST_APP_SINK(sink),
+                                                                  5 * GST_SECOND);
+                if (!sample) {
+                    continue;
+                }
+
+                GstVideoInfo info;
+                GstVideoFrame frame;
+                if (gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) &&
+                    GST_VIDEO_INFO_WIDTH(&info) == THUMBNAIL_WIDTH &&
+                    GST_VIDEO_INFO_HEIGHT(&info) == THUMBNAIL_HEIGHT &&
+                    gst_video_frame_map(&frame, &info, gst_sample_get_buffer(sample),
+                                        GST_MAP_READ))
+                {
+                    std::vector<uint8_t> pixels(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT * 4);
+                    auto data = static_cast<const uint8_t*>(GST_VIDEO_FRAME_PLANE_DATA(&frame, 0));
+                    int stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+                    for (int y = 0; y < THUMBNAIL_HEIGHT; y++) {
+                        std::memcpy(&pixels[y * THUMBNAIL_WIDTH * 4], data + y * stride,
+                                    THUMBNAIL_WIDTH * 4);
+                    }
+                    gst_video_frame_unmap(&frame);
+                    setThumbnail(i, pixels.data());
+                    decoded++;
+                }
+                gst_sample_unref(sample);
+            }
+        }
+        complete = !cancel_ && !failed && decoded == count;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(bus);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+
+    return complete;
+}
+
+void ThumbnailStrip::setThumbnail(size_t index, const uint8_t* pixels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int column = static_cast<int>(index) % columns_;
+    int row = static_cast<int>(index) / columns_;
+    size_t atlas_stride = static_cast<size_t>(columns_) * THUMBNAIL_WIDTH * 4;
+    for (int y = 0; y < THUMBNAIL_HEIGHT; y++) {
+        size_t offset = (row * THUMBNAIL_HEIGHT + y) * atlas_stride + column * THUMBNAIL_WIDTH * 4;
+        std::memcpy(&atlas_[offset], pixels + y * THUMBNAIL_WIDTH * 4, THUMBNAIL_WIDTH * 4);
+    }
+    decoded_[index] = true;
+    atlas_changed_ = true;
+}
+
+bool ThumbnailStrip::save() const {
+    std::error_code ec;
+    fs::create_directories(fs::path(cache_path_).parent_path(), ec);
+
+    json j;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        j["width"] = THUMBNAIL_WIDTH;
+        j["height"] = THUMBNAIL_HEIGHT;
+        j["count"] = count_;
+        j["columns"] = columns_;
+        j["duration"] = duration_;
+
+        // the pixels are written first, the metadata only refers to a complete atlas
+        std::string tmp_path = cache_path_ + ".rgba.tmp";
+        std::ofstream atlas_file(tmp_path, std::ios::binary);
+        if (!atlas_file.is_open() ||
+            !atlas_file.write(reinterpret_cast<const char*>(atlas_.data()), atlas_.size()))
+        {
+            spdlog::error("Failed to save thumbnails to: {}", cache_path_);
+            return false;
+        }
+        atlas_file.close();
+        fs::rename(tmp_path, cache_path_ + ".rgba", ec);
+        if (ec) {
+            spdlog::error("Failed to save thumbnails to: {}", cache_path_);
+            return false;
+        }
+    }
+
+    std::string tmp_path = cache_path_ + ".json.tmp";
+    std::ofstream outfile(tmp_path);
+    if (outfile.is_open()) {
+        outfile << j << std::endl;
+        outfile.close();
+
+        fs::rename(tmp_path, cache_path_ + ".json", ec);
+        if (!ec) {
+            return true;
+        }
+    }
+
+    spdlog::error("Failed to save thumbnails to: {}", cache_path_);
+    return false;
+}
+
+} // namespace just_annotate
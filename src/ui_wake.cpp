@@ -0,0 +1,25 @@
+#include <just_annotate/ui_wake.h>
+
+#include <atomic>
+
+namespace just_annotate {
+
+void (*wake_handler)() = nullptr;
+std::atomic<bool> ui_idle{false};
+
+void setWakeHandler(void (*handler)()) {
+    wake_handler = handler;
+}
+
+void setUiIdle(bool is_idle) {
+    ui_idle = is_idle;
+}
+
+void wakeUi() {
+    // only the first of several wakes while asleep is posted
+    if (wake_handler && ui_idle.exchange(false)) {
+        wake_handler();
+    }
+}
+
+} // namespace just_annotate
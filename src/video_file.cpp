@@ -1,153 +1,800 @@
 #include <just_annotate/video_file.h>
 
+#include <just_annotate/frame_ring.h>
+#include <just_annotate/keyframe_index.h>
+#include <just_annotate/ui_wake.h>
+#include <just_annotate/yuv_converter.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <deque>
-
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// buffer objects are core since OpenGL 1.5, but only declared as extensions by GL/gl.h
+#define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
+#include <GL/glext.h>
 #include <glib.h>
 #include <gst/gst.h>
+#include <gst/gl/gl.h>
 #include <gst/video/video.h>
 #include <gst/app/app.h>
 #include <spdlog/spdlog.h>
 
+// last, the X11 headers define macros that clash with other headers
+#if GST_GL_HAVE_WINDOW_X11 && GST_GL_HAVE_PLATFORM_GLX
+#include <GL/glx.h>
+#include <gst/gl/x11/gstgldisplay_x11.h>
+#endif
+
 namespace just_annotate {
 
+const size_t DEFAULT_FRAME_CACHE_SIZE = 512 << 20;
+// frames decoded on either side of a paused video
+const int PREFETCH_FRAMES = 15;
+// frame steps that can be queued up while the pipeline is busy
+const int MAX_PENDING_STEPS = 30;
+// completed seeks the latency statistics are computed over
+const size_t SEEK_LATENCY_HISTORY = 100;
+// pixel buffer objects uploads are rotated through, so that a new frame never waits for the
+// transfer of the previous one
+const int PIXEL_BUFFER_COUNT = 3;
+// uploads the upload time statistics are computed over
+const size_t UPLOAD_TIME_HISTORY = 100;
+// memory budget of the frames kept referenced after being displayed; GL frames are also limited in
+// number, they are drawn from the decoder's buffer pool, which they would otherwise starve
+const size_t DEFAULT_FRAME_MEMORY = 64 << 20;
+const size_t GL_FRAME_BUFFER_SIZE = 4;
+// decoded frames that can be waiting for the UI thread before new ones are dropped
+const size_t FRAME_RING_SIZE = 8;
+// buffers the converter's pool allocates up front, for a full ring and the displayed frame
+const guint FRAME_POOL_MIN_BUFFERS = FRAME_RING_SIZE + 2;
+// how far ahead of their time frames are handed over while playing, so that the frame due at the
+// next swap is there when the UI picks it, however long the UI took for the frame before
+const gint64 PRESENT_LEAD = 40 * GST_MSECOND;
+// bound of the expected time from an update until its frame is on screen
+const double MAX_PRESENT_DELAY_MS = 50.0;
+// swaps the presentation latency statistics are computed over
+const size_t PRESENT_LATENCY_HISTORY = 100;
+
+// a new display size is only negotiated once it has been stable for this long
+const auto DISPLAY_SIZE_DEBOUNCE = std::chrono::milliseconds(300);
+// smaller changes of the displayed height don't renegotiate the output size
+const double DISPLAY_SIZE_TOLERANCE = 0.05;
+// times in seconds, e.g. of spans stored as floats, are only accurate to a fraction of a
+// millisecond, so times within this of the start of a frame belong to that frame
+const int64_t FRAME_TIME_TOLERANCE = 1000000;
+// playback rates, above which only keyframes are decoded because decoding every frame can't keep
+// up; slow motion below 1x decodes normally
+const double MIN_RATE = 0.25;
+const double MAX_RATE = 16.0;
+const double MAX_DECODED_RATE = 2.0;
+// pipelines of closed videos kept for reuse
+const size_t MAX_POOLED_PIPELINES = 2;
+
+// what the profiles after AUTO change at runtime, the rest is only read when a decoder opens
+struct DecoderSettings {
+    // skip-frame of the gst-libav decoders, 1 skips the frames no other frame references
+    int skip_frame;
+    // lets the sink report late frames upstream, which decoders answer by skipping frames
+    bool qos;
+};
+const DecoderSettings DECODER_SETTINGS[] = {
+    {0, false}, // QUALITY
+    {0, true},  // PLAYBACK
+    {1, true},  // SCRUB
+};
+const int DECODER_PROFILE_COUNT = 3;
+
+int profile_index(DecoderProfile profile) {
+    return static_cast<int>(profile) - static_cast<int>(DecoderProfile::QUALITY);
+}
+
+// the application's GL context, wrapped for GStreamer by VideoFile::initGL()
+GstGLDisplay* gl_display = nullptr;
+GstGLContext* gl_app_context = nullptr;
+
+// what the bus thread reports to the UI thread, which owns the pipeline's state
+enum class BusEvent {
+    END_OF_STREAM,
+    DURATION_CHANGED,
+    ERROR
+};
+
 struct VideoFile::Impl {
     GstElement* pipeline = nullptr;
     GstElement* uridecodebin = nullptr;
     GstElement* videoconvert = nullptr;
     GstElement* framesink = nullptr;
-    GMainLoop* loop = nullptr;
+    // bus messages are handled by a main loop of their own, on a thread of their own
+    GMainContext* bus_context = nullptr;
+    GMainLoop* bus_loop = nullptr;
+    GSource* bus_source = nullptr;
+    std::thread bus_thread;
+    std::mutex bus_mutex;
+    std::deque<BusEvent> bus_events;
+    // decoded frames on their way from the streaming thread to the UI thread
+    FrameRing frame_ring{FRAME_RING_SIZE};
+    // frames already displayed, which stay referenced within the frame memory budget, only used
+    // on the UI thread
     std::deque<GstBuffer*> frame_buffer;
-    bool new_frame = false;
+    size_t frame_buffer_bytes = 0;
+    size_t frame_memory = DEFAULT_FRAME_MEMORY;
+    // frame buffers seen for the first time, rather than coming back from a buffer pool
+    std::atomic<size_t> frame_allocations{0};
+    // formats of the frames handed to the application, and the complete caps including the
+    // output size, which prefetching uses as well
+    std::string frame_caps = "video/x-raw,format=RGBA";
+    std::string output_caps;
+    std::unique_ptr<YuvConverter> yuv_converter;
+    // output size follows the displayed size, unless the native resolution is requested
+    GstElement* videoscale = nullptr;
+    GstElement* scalecaps = nullptr;
+    bool native_resolution = false;
+    int display_width = 0;
+    int display_height = 0;
+    std::chrono::steady_clock::time_point display_size_changed;
+    bool display_size_pending = false;
+    // 0 while the output has the source resolution
+    int output_width = 0;
+    int output_height = 0;
+    // scaling and conversion time of the latest frame, measured between pad probes
+    std::atomic<int64_t> convert_start_ns{0};
+    std::atomic<double> convert_ms{0};
+    std::map<std::pair<int, int>, ResolutionStats> resolution_stats;
+    std::chrono::steady_clock::time_point last_update;
+    // video decoders, as uridecodebin sets them up, for switching their profile
+    std::mutex decoder_mutex;
+    std::vector<GstElement*> decoders;
+    int decoder_threads = 0;
+    DecoderProfile selected_profile = DecoderProfile::AUTO;
+    // also read by the streaming threads, which set up decoders and count their frames
+    std::atomic<DecoderProfile> active_profile{DecoderProfile::QUALITY};
+    std::atomic<size_t> profile_frames[DECODER_PROFILE_COUNT] = {};
+    double profile_seconds[DECODER_PROFILE_COUNT] = {};
+    // frames stay in GL memory and are drawn from the decoder's textures
+    bool gl_output = false;
+    uint32_t gl_texture = 0;
     bool wait_for_next_frame = true;
-    bool end_of_stream = false;
+    // also read by the streaming thread, which drops frames after the end of the stream
+    std::atomic<bool> end_of_stream{false};
+    // decoded frames only go into the frame cache while paused, playback would otherwise cycle
+    // every frame it decodes through the cache
+    std::atomic<bool> cache_frames{true};
     bool is_forward = true;
+    // playback rate, negative for playing backwards, always 1 while paused
+    double rate = 1.0;
+    std::string uri;
+    FrameCache::Ptr frame_cache = std::make_shared<FrameCache>(DEFAULT_FRAME_CACHE_SIZE);
+    std::unique_ptr<FramePrefetcher> prefetcher;
+    std::atomic<int64_t> frame_duration{0};
+    int64_t prefetch_center = -1;
+    // reverse stepping decodes the GOP before the cached frames forward, then walks it backwards
+    bool reverse_stepping = false;
+    int64_t prefetch_gop_end = -1;
+    KeyframeIndex::Ptr keyframe_index;
+    int64_t scrub_target = -1;
+    SeekStats seek_stats;
+    bool timing_seek = false;
+    std::chrono::steady_clock::time_point seek_start;
+    std::deque<double> seek_latencies;
+    // texture storage is only allocated when the resolution changes
+    int texture_width = 0;
+    int texture_height = 0;
+    bool use_pixel_buffers = true;
+    bool pixel_buffers_supported = false;
+    bool pixel_buffers_checked = false;
+    GLuint pixel_buffers[PIXEL_BUFFER_COUNT] = {};
+    size_t pixel_buffer_size = 0;
+    int pixel_buffer_index = 0;
+    size_t uploads = 0;
+    std::deque<double> upload_times;
+    // frames handed over while playing that aren't due on screen yet, only used on the UI thread
+    std::deque<FrameRing::Frame> pending_frames;
+    PresentStats present_stats;
+    std::chrono::steady_clock::time_point update_time;
+    // handed over time of the frame shown by the last update, until its swap is reported
+    int64_t unpresented_arrival = -1;
+    std::deque<double> present_latencies;
+    // a pipeline that reported an error isn't reused
+    bool failed = false;
+    // the texture of the closed video, while the pipeline is pooled
+    GLuint pooled_texture = 0;
+    bool timing_open = false;
+    bool open_pooled = false;
+    std::chrono::steady_clock::time_point open_start;
 };
 
-void sync_bus_call(GstBus* /* bus */, GstMessage * msg, gpointer data)
+// pipelines of closed videos, kept in the READY state so that the next video with the same output
+// path only has to swap the URI rather than build and tear down a whole pipeline
+std::vector<std::unique_ptr<VideoFile::Impl>> pipeline_pool;
+OpenStats open_stats;
+
+bool has_pixel_buffer_objects() {
+    // pixel buffer objects are core since OpenGL 2.1
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    int major = 0;
+    int minor = 0;
+    if (version && sscanf(version, "%d.%d", &major, &minor) == 2 &&
+        (major > 2 || (major == 2 && minor >= 1)))
+    {
+        return true;
+    }
+
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    return extensions && strstr(extensions, "GL_ARB_pixel_buffer_object");
+}
+
+// runs on the thread that posted the message, for the messages that need an answer before that
+// thread can continue
+void sync_bus_call(GstBus* /* bus */, GstMessage * msg, gpointer /* data */)
 {
   switch (GST_MESSAGE_TYPE (msg)) {
-    case GST_MESSAGE_EOS:
+    case GST_MESSAGE_NEED_CONTEXT:
     {
-        g_print("End of stream\n");
-        VideoFile::Impl* video_file_impl = static_cast<VideoFile::Impl*>(data);
-        if (video_file_impl->is_forward) {
-            auto seek_event = gst_event_new_seek (1, GST_FORMAT_TIME,
-                GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE), GST_SEEK_TYPE_SET,
-                0, GST_SEEK_TYPE_END, 0);
-            gst_element_send_event(video_file_impl->pipeline, seek_event);
-
-            video_file_impl->end_of_stream = true;
-            gst_element_set_state(video_file_impl->pipeline, GST_STATE_PAUSED);
+        // lets the GL elements share textures with the application's context
+        const gchar* context_type = nullptr;
+        gst_message_parse_context_type(msg, &context_type);
+        if (gl_display && g_strcmp0(context_type, GST_GL_DISPLAY_CONTEXT_TYPE) == 0) {
+            GstContext* context = gst_context_new(GST_GL_DISPLAY_CONTEXT_TYPE, TRUE);
+            gst_context_set_gl_display(context, gl_display);
+            gst_element_set_context(GST_ELEMENT(GST_MESSAGE_SRC(msg)), context);
+            gst_context_unref(context);
         }
-        else {
-            auto seek_event = gst_event_new_seek (1, GST_FORMAT_TIME,
-                GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE), GST_SEEK_TYPE_SET,
-                0, GST_SEEK_TYPE_END, 0);
-            gst_element_send_event(video_file_impl->pipeline, seek_event);
-            video_file_impl->is_forward = true;
+        else if (gl_app_context && g_strcmp0(context_type, "gst.gl.app_context") == 0) {
+            GstContext* context = gst_context_new("gst.gl.app_context", TRUE);
+            GstStructure* structure = gst_context_writable_structure(context);
+            gst_structure_set(structure, "context", GST_TYPE_GL_CONTEXT, gl_app_context, nullptr);
+            gst_element_set_context(GST_ELEMENT(GST_MESSAGE_SRC(msg)), context);
+            gst_context_unref(context);
         }
     }
     break;
-    case GST_MESSAGE_ERROR:
-    {
-        gchar *debug;
-        GError *error;
-        gst_message_parse_error(msg, &error, &debug);
-        g_printerr("Error: %s\n", error->message);
-        g_error_free(error);
-        g_free(debug);
-        break;
-    }
-    break;
     default:
       break;
   }
 }
 
-void on_gst_buffer(GstElement* sink, gpointer data)
-{
+// runs on the bus thread, which only reports to the UI thread rather than changing the pipeline
+gboolean on_bus_message(GstBus* /* bus */, GstMessage* msg, gpointer data) {
     VideoFile::Impl* video_file_impl = static_cast<VideoFile::Impl*>(data);
-    if (video_file_impl->end_of_stream) {
-        return;
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_EOS:
+        {
+            spdlog::debug("End of stream");
+            std::lock_guard<std::mutex> lock(video_file_impl->bus_mutex);
+            video_file_impl->bus_events.push_back(BusEvent::END_OF_STREAM);
+            wakeUi();
+            break;
+        }
+        case GST_MESSAGE_DURATION_CHANGED:
+        {
+            std::lock_guard<std::mutex> lock(video_file_impl->bus_mutex);
+            video_file_impl->bus_events.push_back(BusEvent::DURATION_CHANGED);
+            wakeUi();
+            break;
+        }
+        case GST_MESSAGE_ERROR:
+        {
+            GError* error = nullptr;
+            gchar* debug = nullptr;
+            gst_message_parse_error(msg, &error, &debug);
+            spdlog::error("Error: {}", error->message);
+            g_clear_error(&error);
+            g_free(debug);
+
+            std::lock_guard<std::mutex> lock(video_file_impl->bus_mutex);
+            video_file_impl->bus_events.push_back(BusEvent::ERROR);
+            wakeUi();
+            break;
+        }
+        case GST_MESSAGE_WARNING:
+        {
+            GError* error = nullptr;
+            gst_message_parse_warning(msg, &error, nullptr);
+            spdlog::warn("Warning: {}", error->message);
+            g_clear_error(&error);
+            break;
+        }
+        default:
+            break;
     }
 
-    GstSample* sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
-    if (!sample) {
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean quit_bus_loop(gpointer data) {
+    g_main_loop_quit(static_cast<GMainLoop*>(data));
+    return G_SOURCE_REMOVE;
+}
+
+// runs after any message the bus thread was dispatching when it was invoked
+gboolean signal_bus_barrier(gpointer data) {
+    static_cast<std::promise<void>*>(data)->set_value();
+    return G_SOURCE_REMOVE;
+}
+
+bool has_property(GstElement* element, const char* name) {
+    return g_object_class_find_property(G_OBJECT_GET_CLASS(element), name) != nullptr;
+}
+
+// decoders without the property, e.g. hardware decoders, keep their defaults
+void apply_decoder_settings(GstElement* decoder, DecoderProfile profile) {
+    const auto& settings = DECODER_SETTINGS[profile_index(profile)];
+    if (has_property(decoder, "skip-frame")) {
+        g_object_set(decoder, "skip-frame", settings.skip_frame, nullptr);
+    }
+}
+
+// runs on the streaming thread that plugs the element, before it's started
+void on_element_added(GstBin* /* bin */, GstBin* /* sub_bin */, GstElement* element,
+                      gpointer data)
+{
+    GstElementFactory* factory = gst_element_get_factory(element);
+    if (!factory || !gst_element_factory_list_is_type(factory,
+            GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO))
+    {
         return;
     }
 
-    // decrement reference counts of expired frames
-    while (video_file_impl->frame_buffer.size() > 30) {
-        gst_buffer_unref(video_file_impl->frame_buffer.front());
-        video_file_impl->frame_buffer.pop_front();
+    VideoFile::Impl* video_file_impl = static_cast<VideoFile::Impl*>(data);
+    if (has_property(element, "max-threads")) {
+        g_object_set(element, "max-threads", video_file_impl->decoder_threads, nullptr);
     }
 
-    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    std::lock_guard<std::mutex> lock(video_file_impl->decoder_mutex);
+    apply_decoder_settings(element, video_file_impl->active_profile);
+    video_file_impl->decoders.push_back(GST_ELEMENT(gst_object_ref(element)));
+    spdlog::debug("Set up video decoder {}", GST_ELEMENT_NAME(element));
+}
 
-    // increment the reference count for the new frame
-    video_file_impl->frame_buffer.push_back(buffer);
-    gst_buffer_ref(video_file_impl->frame_buffer.back());
+void on_element_removed(GstBin* /* bin */, GstBin* /* sub_bin */, GstElement* element,
+                        gpointer data)
+{
+    VideoFile::Impl* video_file_impl = static_cast<VideoFile::Impl*>(data);
+    std::lock_guard<std::mutex> lock(video_file_impl->decoder_mutex);
+    auto& decoders = video_file_impl->decoders;
+    auto it = std::find(decoders.begin(), decoders.end(), element);
+    if (it != decoders.end()) {
+        gst_object_unref(*it);
+        decoders.erase(it);
+    }
+}
 
-    video_file_impl->new_frame = true;
+int64_t steady_time_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-VideoFile::VideoFile() : impl_(std::make_unique<Impl>()) {
+// scaling and conversion run on the decoder's streaming thread, so the time between a buffer
+// entering the scaler and leaving the caps filter is what they cost for it
+GstPadProbeReturn on_convert_start(GstPad* /* pad */, GstPadProbeInfo* /* info */, gpointer data) {
+    VideoFile::Impl* video_file_impl = static_cast<VideoFile::Impl*>(data);
+    video_file_impl->convert_start_ns = steady_time_ns();
+    return GST_PAD_PROBE_OK;
 }
 
-VideoFile::~VideoFile() {
+GstPadProbeReturn on_convert_end(GstPad* /* pad */, GstPadProbeInfo* /* info */, gpointer data) {
+    VideoFile::Impl* video_file_impl = static_cast<VideoFile::Impl*>(data);
+    video_file_impl->convert_ms = (steady_time_ns() - video_file_impl->convert_start_ns) * 1e-6;
+    return GST_PAD_PROBE_OK;
+}
+
+// the converter allocates its output from a pool with the buffers for a full ring up front, and the
+// buffers that the ring, the retained frames and the frame cache release go back into it
+GstPadProbeReturn on_allocation_query(GstPad* /* pad */, GstPadProbeInfo* info,
+                                      gpointer /* data */)
+{
+    GstQuery* query = GST_PAD_PROBE_INFO_QUERY(info);
+    if (GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstCaps* caps = nullptr;
+    gboolean need_pool = FALSE;
+    gst_query_parse_allocation(query, &caps, &need_pool);
+    GstVideoInfo video_info;
+    if (!caps || !gst_video_info_from_caps(&video_info, caps)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // the pool isn't limited in size, frames cached while paused would otherwise block decoding
+    // until they are evicted, which only happens when new frames arrive; while playing only the
+    // ring and the retained frames hold its buffers
+    guint size = static_cast<guint>(GST_VIDEO_INFO_SIZE(&video_info));
+    GstBufferPool* pool = gst_video_buffer_pool_new();
+    GstStructure* config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, size, FRAME_POOL_MIN_BUFFERS, 0);
+    if (!gst_buffer_pool_set_config(pool, config)) {
+        gst_object_unref(pool);
+        return GST_PAD_PROBE_OK;
+    }
+
+    gst_query_add_allocation_pool(query, pool, size, FRAME_POOL_MIN_BUFFERS, 0);
+    gst_query_add_allocation_meta(query, GST_VIDEO_META_API_TYPE, nullptr);
+    gst_object_unref(pool);
+    return GST_PAD_PROBE_HANDLED;
+}
+
+// runs on the streaming thread, so it only hands the frame over rather than touching the UI state
+GstFlowReturn on_new_sample(GstAppSink* sink, gpointer data) {
+    VideoFile::Impl* video_file_impl = static_cast<VideoFile::Impl*>(data);
+    GstSample* sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_OK;
+    }
+    if (video_file_impl->end_of_stream) {
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+
+    video_file_impl->profile_frames[profile_index(video_file_impl->active_profile)]++;
+
+    // pooled buffers keep their qdata when they are recycled, so only new ones are unmarked
+    static GQuark seen_quark = g_quark_from_static_string("just-annotate-frame-seen");
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if (!gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer), seen_quark)) {
+        gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer), seen_quark, GINT_TO_POINTER(1), nullptr);
+        video_file_impl->frame_allocations++;
+    }
+
+    FrameRing::Frame frame;
+    GstVideoInfo info;
+    if (gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+        frame.width = GST_VIDEO_INFO_WIDTH(&info);
+        frame.height = GST_VIDEO_INFO_HEIGHT(&info);
+        frame.format = GST_VIDEO_INFO_FORMAT(&info);
+        if (info.fps_n > 0) {
+            video_file_impl->frame_duration =
+              gst_util_uint64_scale_int(GST_SECOND, info.fps_d, info.fps_n);
+        }
+    }
+
+    // frames decoded while paused are kept so that revisiting them doesn't need a seek, except for
+    // frames in GL memory, which the prefetch pipeline decodes into system memory instead
+    if (video_file_impl->gl_output || !video_file_impl->cache_frames) {
+        frame.pts = FrameCache::getStreamTime(sample);
+    }
+    else {
+        frame.pts = video_file_impl->frame_cache->insert(sample);
+    }
+
+    // running time follows the rate, and playing backwards a frame is due from its end
+    const GstSegment* segment = gst_sample_get_segment(sample);
+    if (segment && GST_BUFFER_PTS_IS_VALID(buffer)) {
+        guint64 start = GST_BUFFER_PTS(buffer);
+        guint64 stop = start + (GST_BUFFER_DURATION_IS_VALID(buffer)
+                                    ? GST_BUFFER_DURATION(buffer)
+                                    : static_cast<guint64>(video_file_impl->frame_duration));
+        guint64 running_time = gst_segment_to_running_time(segment, GST_FORMAT_TIME,
+                                                           segment->rate < 0 ? stop : start);
+        guint64 running_end = gst_segment_to_running_time(segment, GST_FORMAT_TIME,
+                                                          segment->rate < 0 ? start : stop);
+        if (GST_CLOCK_TIME_IS_VALID(running_time)) {
+            frame.running_time = static_cast<int64_t>(running_time);
+        }
+        if (GST_CLOCK_TIME_IS_VALID(running_end)) {
+            frame.running_end = static_cast<int64_t>(running_end);
+        }
+    }
+    frame.arrival = steady_time_ns();
+
+    frame.buffer = gst_buffer_ref(buffer);
+    if (!video_file_impl->frame_ring.push(frame)) {
+        gst_buffer_unref(frame.buffer);
+        video_file_impl->frame_ring.countDropped();
+    }
+    gst_sample_unref(sample);
+    wakeUi();
+
+    return GST_FLOW_OK;
+}
+
+void release_pipeline(VideoFile::Impl& impl, GLuint texture_id) {
+    impl.prefetcher.reset();
+    impl.yuv_converter.reset();
+
+    if (impl.pixel_buffers[0] != 0) {
+        glDeleteBuffers(PIXEL_BUFFER_COUNT, impl.pixel_buffers);
+    }
+    if (texture_id != 0) {
+        glDeleteTextures(1, &texture_id);
+    }
+
     // set pipeline state to null
-    pause(true);
-    gst_element_set_state(impl_->pipeline, GST_STATE_NULL);
+    gst_element_set_state(impl.pipeline, GST_STATE_NULL);
 
-    // remove bus watch
-    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE (impl_->pipeline));
-    gst_bus_remove_watch(bus);
-    gst_object_unref(bus);
+    // stop the bus thread, quitting from within the loop can't race with it starting to run
+    g_main_context_invoke(impl.bus_context, quit_bus_loop, impl.bus_loop);
+    impl.bus_thread.join();
+    g_source_destroy(impl.bus_source);
+    g_source_unref(impl.bus_source);
+    g_main_loop_unref(impl.bus_loop);
+    g_main_context_unref(impl.bus_context);
 
     // unreference pipeline resources
-    gst_object_unref(impl_->pipeline);
-    gst_object_unref(impl_->uridecodebin);
-    gst_object_unref(impl_->videoconvert);
-    gst_object_unref(impl_->framesink);
-    for (auto frame: impl_->frame_buffer) {
+    gst_object_unref(impl.pipeline);
+    gst_object_unref(impl.uridecodebin);
+    gst_object_unref(impl.videoconvert);
+    gst_object_unref(impl.framesink);
+    if (impl.videoscale) {
+        gst_object_unref(impl.videoscale);
+        gst_object_unref(impl.scalecaps);
+    }
+    for (auto frame: impl.frame_buffer) {
         gst_buffer_unref(frame);
     }
-    impl_->frame_buffer.clear();
-    g_main_loop_unref(impl_->loop);
+    impl.frame_buffer.clear();
+    impl.frame_buffer_bytes = 0;
+    impl.frame_ring.clear();
+    for (auto& frame: impl.pending_frames) {
+        gst_buffer_unref(frame.buffer);
+    }
+    impl.pending_frames.clear();
+    for (auto decoder: impl.decoders) {
+        gst_object_unref(decoder);
+    }
+    impl.decoders.clear();
+}
+
+VideoFile::VideoFile() : impl_(std::make_unique<Impl>()) {
+}
+
+VideoFile::~VideoFile() {
+    pause(true);
+    if (!recycle()) {
+        release_pipeline(*impl_, texture_id_);
+    }
 }
 
-VideoFile::Ptr VideoFile::open(const std::string& path) {
+VideoFile::Ptr VideoFile::open(const std::string& path, const VideoOptions& options) {
+    auto open_start = std::chrono::steady_clock::now();
     auto video_file = std::shared_ptr<VideoFile>(new VideoFile());
 
     video_file->path_ = path;
-    video_file->impl_->loop = g_main_loop_new(nullptr, false);
+    video_file->duration_ = options.duration;
+
+    // a pooled pipeline is reused if it delivers frames the same way this video would
+    bool gl_output = options.gl_output && gl_app_context;
+    bool yuv_upload = !gl_output && options.yuv_upload && YuvConverter::isSupported();
+    auto pooled_it = std::find_if(pipeline_pool.begin(), pipeline_pool.end(),
+        [&](const std::unique_ptr<Impl>& impl) {
+            return impl->gl_output == gl_output && (impl->yuv_converter != nullptr) == yuv_upload &&
+                   impl->decoder_threads == options.decoder_threads;
+        });
+    if (pooled_it != pipeline_pool.end()) {
+        video_file->impl_ = std::move(*pooled_it);
+        pipeline_pool.erase(pooled_it);
+        video_file->reuse(path);
+        video_file->impl_->open_pooled = true;
+    }
+    else {
+        video_file->build(path, options);
+        video_file->impl_->open_pooled = false;
+    }
+
+    video_file->impl_->open_start = open_start;
+    video_file->impl_->timing_open = true;
+    video_file->impl_->last_update = std::chrono::steady_clock::now();
+    gst_element_set_state(video_file->impl_->pipeline, GST_STATE_PLAYING);
+    video_file->impl_->wait_for_next_frame = true;
+    video_file->update();
+
+    return video_file;
+}
+
+void VideoFile::build(const std::string& path, const VideoOptions& options) {
+    impl_->uri = "file://" + path;
+    impl_->decoder_threads = options.decoder_threads;
+    impl_->keyframe_index = KeyframeIndex::open(path);
+    std::string config = "uridecodebin name=source uri=";
+    config += impl_->uri;
+
+    if (options.gl_output && !gl_app_context) {
+        spdlog::warn("GL output isn't available, converting frames in system memory.");
+    }
+    else if (options.gl_output) {
+        std::string gl_config = config + " ! glupload ! glcolorconvert";
+        gl_config += " ! video/x-raw(memory:GLMemory),format=RGBA,texture-target=2D";
+        gl_config += " ! appsink name=framesink sync=1";
+        GError* error = nullptr;
+        impl_->pipeline = gst_parse_launch(gl_config.c_str(), &error);
+        if (impl_->pipeline) {
+            impl_->gl_output = true;
+        }
+        else {
+            spdlog::warn("Failed to create GL pipeline, converting frames in system memory: {}",
+                         error ? error->message : "unknown");
+        }
+        g_clear_error(&error);
+    }
 
-    std::string config = "uridecodebin name=source uri=file://";
-    config += path;
-    config += " ! videoconvert ! video/x-raw,format=RGBA ! appsink name=framesink sync=1";
-    video_file->impl_->pipeline = gst_parse_launch(config.c_str(), nullptr);
-    video_file->impl_->uridecodebin = gst_bin_get_by_name(GST_BIN(video_file->impl_->pipeline), "source");
-    video_file->impl_->videoconvert = gst_bin_get_by_name(GST_BIN(video_file->impl_->pipeline), "convert");
-    video_file->impl_->framesink = gst_bin_get_by_name(GST_BIN(video_file->impl_->pipeline), "framesink");
+    if (!impl_->pipeline) {
+        // 4:2:0 frames pass through as decoded and are converted by a shader, which saves a CPU
+        // conversion and more than half the upload size; anything else is still converted to RGBA
+        if (options.yuv_upload && YuvConverter::isSupported()) {
+            impl_->frame_caps = "video/x-raw,format=(string){NV12,I420,RGBA}";
+            impl_->yuv_converter = std::make_unique<YuvConverter>();
+        }
+        // scaling before the conversion means only the displayed pixels are converted
+        config += " ! videoscale name=scale ! videoconvert name=convert";
+        config += " ! capsfilter name=scalecaps ! appsink name=framesink sync=1";
+        impl_->pipeline = gst_parse_launch(config.c_str(), nullptr);
+
+        auto impl = impl_.get();
+        impl->videoscale = gst_bin_get_by_name(GST_BIN(impl->pipeline), "scale");
+        impl->scalecaps = gst_bin_get_by_name(GST_BIN(impl->pipeline), "scalecaps");
+        GstCaps* caps = gst_caps_from_string(impl->frame_caps.c_str());
+        g_object_set(impl->scalecaps, "caps", caps, nullptr);
+        gst_caps_unref(caps);
+
+        GstPad* scale_pad = gst_element_get_static_pad(impl->videoscale, "sink");
+        gst_pad_add_probe(scale_pad, GST_PAD_PROBE_TYPE_BUFFER, on_convert_start, impl, nullptr);
+        gst_object_unref(scale_pad);
+        GstPad* caps_pad = gst_element_get_static_pad(impl->scalecaps, "src");
+        gst_pad_add_probe(caps_pad, GST_PAD_PROBE_TYPE_BUFFER, on_convert_end, impl, nullptr);
+        gst_object_unref(caps_pad);
+    }
+    impl_->uridecodebin = gst_bin_get_by_name(GST_BIN(impl_->pipeline), "source");
+    impl_->videoconvert = gst_bin_get_by_name(GST_BIN(impl_->pipeline), "convert");
+    impl_->framesink = gst_bin_get_by_name(GST_BIN(impl_->pipeline), "framesink");
+
+    GstAppSinkCallbacks callbacks = {};
+    callbacks.new_sample = on_new_sample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(impl_->framesink), &callbacks, impl_.get(), nullptr);
+    g_object_set(impl_->framesink, "ts-offset", -PRESENT_LEAD, nullptr);
+    if (!impl_->gl_output) {
+        GstPad* sink_pad = gst_element_get_static_pad(impl_->framesink, "sink");
+        gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, on_allocation_query,
+                          nullptr, nullptr);
+        gst_object_unref(sink_pad);
+    }
 
-    g_object_set(video_file->impl_->framesink, "emit-signals", TRUE, nullptr);
-    g_signal_connect(video_file->impl_->framesink, "new-sample", G_CALLBACK(on_gst_buffer), video_file->impl_.get());
+    auto impl = impl_.get();
+    g_signal_connect(impl->pipeline, "deep-element-added", G_CALLBACK(on_element_added), impl);
+    g_signal_connect(impl->pipeline, "deep-element-removed", G_CALLBACK(on_element_removed),
+                     impl);
 
-    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE (video_file->impl_->pipeline));
-    gst_bus_add_signal_watch(bus);
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE (impl->pipeline));
     gst_bus_enable_sync_message_emission(bus);
-    g_signal_connect(bus, "sync-message", G_CALLBACK(sync_bus_call), video_file->impl_.get());
+    g_signal_connect(bus, "sync-message", G_CALLBACK(sync_bus_call), impl);
+
+    impl->bus_context = g_main_context_new();
+    impl->bus_loop = g_main_loop_new(impl->bus_context, FALSE);
+    impl->bus_source = gst_bus_create_watch(bus);
+    g_source_set_callback(impl->bus_source, reinterpret_cast<GSourceFunc>(on_bus_message), impl,
+                          nullptr);
+    g_source_attach(impl->bus_source, impl->bus_context);
     gst_object_unref(bus);
+    impl->bus_thread = std::thread([impl]() {
+        g_main_context_push_thread_default(impl->bus_context);
+        g_main_loop_run(impl->bus_loop);
+        g_main_context_pop_thread_default(impl->bus_context);
+    });
+}
 
-    gst_element_set_state(video_file->impl_->pipeline, GST_STATE_PLAYING);
-    video_file->impl_->wait_for_next_frame = true;
-    video_file->update();
+void VideoFile::reuse(const std::string& path) {
+    auto impl = impl_.get();
+    impl->uri = "file://" + path;
+    g_object_set(impl->uridecodebin, "uri", impl->uri.c_str(), nullptr);
+    impl->keyframe_index = KeyframeIndex::open(path);
+    impl->frame_cache->setMaxBytes(DEFAULT_FRAME_CACHE_SIZE);
+    impl->frame_memory = DEFAULT_FRAME_MEMORY;
+    impl->frame_allocations = 0;
+    texture_id_ = impl->pooled_texture;
+    impl->pooled_texture = 0;
+    // the GL texture belonged to a buffer of the previous video, which has been released
+    impl->gl_texture = 0;
+
+    // everything that belonged to the previous video starts over
+    impl->end_of_stream = false;
+    impl->cache_frames = true;
+    impl->is_forward = true;
+    impl->rate = 1.0;
+    impl->frame_duration = 0;
+    impl->prefetch_center = -1;
+    impl->reverse_stepping = false;
+    impl->prefetch_gop_end = -1;
+    impl->scrub_target = -1;
+    impl->seek_stats = {};
+    impl->timing_seek = false;
+    impl->seek_latencies.clear();
+    impl->uploads = 0;
+    impl->upload_times.clear();
+    impl->present_stats = {};
+    impl->unpresented_arrival = -1;
+    impl->present_latencies.clear();
+    impl->resolution_stats.clear();
+    for (auto& frames: impl->profile_frames) {
+        frames = 0;
+    }
+    for (auto& seconds: impl->profile_seconds) {
+        seconds = 0;
+    }
+    impl->selected_profile = DecoderProfile::AUTO;
+    applyDecoderProfile(DecoderProfile::QUALITY);
+
+    // the output size is negotiated again, for the aspect ratio of this video
+    impl->native_resolution = false;
+    impl->display_width = 0;
+    impl->display_height = 0;
+    impl->display_size_pending = false;
+    impl->output_width = 0;
+    impl->output_height = 0;
+    impl->output_caps.clear();
+    if (impl->scalecaps) {
+        GstCaps* caps = gst_caps_from_string(impl->frame_caps.c_str());
+        g_object_set(impl->scalecaps, "caps", caps, nullptr);
+        gst_caps_unref(caps);
+    }
+}
 
-    return video_file;
+bool VideoFile::recycle() {
+    if (impl_->failed || pipeline_pool.size() >= MAX_POOLED_PIPELINES) {
+        return false;
+    }
+
+    // READY stops streaming, and uridecodebin drops the source and decoders of this video, while
+    // the converters, the sink, the bus thread and the GL resources are kept
+    if (gst_element_set_state(impl_->pipeline, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+        return false;
+    }
+
+    // messages this video posted before READY mustn't reach the next one: flushing drops those
+    // still queued on the bus, and the barrier waits for one the bus thread is dispatching
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(impl_->pipeline));
+    gst_bus_set_flushing(bus, TRUE);
+    std::promise<void> barrier;
+    g_main_context_invoke(impl_->bus_context, signal_bus_barrier, &barrier);
+    barrier.get_future().wait();
+    gst_bus_set_flushing(bus, FALSE);
+    gst_object_unref(bus);
+
+    bool has_error = false;
+    {
+        std::lock_guard<std::mutex> lock(impl_->bus_mutex);
+        has_error = std::find(impl_->bus_events.begin(), impl_->bus_events.end(),
+                              BusEvent::ERROR) != impl_->bus_events.end();
+        impl_->bus_events.clear();
+    }
+    if (has_error) {
+        return false;
+    }
+
+    impl_->prefetcher.reset();
+    impl_->keyframe_index.reset();
+    for (auto frame: impl_->frame_buffer) {
+        gst_buffer_unref(frame);
+    }
+    impl_->frame_buffer.clear();
+    impl_->frame_buffer_bytes = 0;
+    discardPendingFrames();
+    impl_->frame_cache->clear();
+
+    impl_->pooled_texture = texture_id_;
+    texture_id_ = 0;
+    pipeline_pool.push_back(std::move(impl_));
+    return true;
+}
+
+void VideoFile::clearPool() {
+    for (auto& impl: pipeline_pool) {
+        release_pipeline(*impl, impl->pooled_texture);
+    }
+    pipeline_pool.clear();
+}
+
+OpenStats VideoFile::getOpenStats() {
+    return open_stats;
 }
 
 const std::string& VideoFile::getPath() const {
@@ -158,6 +805,48 @@ void VideoFile::init(int argc, char* argv[]) {
     gst_init(&argc, &argv);
 }
 
+bool VideoFile::initGL() {
+    if (gl_app_context) {
+        return true;
+    }
+
+#if GST_GL_HAVE_WINDOW_X11 && GST_GL_HAVE_PLATFORM_GLX
+    Display* x11_display = glXGetCurrentDisplay();
+    guintptr context_handle = gst_gl_context_get_current_gl_context(GST_GL_PLATFORM_GLX);
+    if (!x11_display || !context_handle) {
+        spdlog::warn("No current GLX context to share with GStreamer.");
+        return false;
+    }
+
+    GstGLAPI gl_api = gst_gl_context_get_current_gl_api(GST_GL_PLATFORM_GLX, nullptr, nullptr);
+    gl_display = GST_GL_DISPLAY(gst_gl_display_x11_new_with_display(x11_display));
+    gl_app_context = gst_gl_context_new_wrapped(gl_display, context_handle, GST_GL_PLATFORM_GLX,
+                                                gl_api);
+    if (!gl_app_context) {
+        spdlog::warn("Failed to wrap the GL context for GStreamer.");
+        gst_clear_object(&gl_display);
+        return false;
+    }
+
+    GError* error = nullptr;
+    gst_gl_context_activate(gl_app_context, TRUE);
+    if (!gst_gl_context_fill_info(gl_app_context, &error)) {
+        spdlog::warn("Failed to query the wrapped GL context: {}",
+                     error ? error->message : "unknown");
+        g_clear_error(&error);
+        gst_gl_context_activate(gl_app_context, FALSE);
+        gst_clear_object(&gl_app_context);
+        gst_clear_object(&gl_display);
+        return false;
+    }
+
+    return true;
+#else
+    spdlog::warn("GL output needs GStreamer built with X11 and GLX support.");
+    return false;
+#endif
+}
+
 
 float VideoFile::getDuration() const {
     return duration_;
@@ -172,151 +861,1062 @@ int VideoFile::getHeight() const {
 }
 
 uint32_t VideoFile::getTextureId() {
+    // a reused pipeline's texture still shows the last frame of the previous video
+    if (!has_frame_) {
+        return 0;
+    }
+    // frames served from the frame cache are always uploaded into the texture of our own
+    if (impl_->gl_output && impl_->gl_texture != 0 && !cache_served_) {
+        return impl_->gl_texture;
+    }
     return texture_id_;
 }
 
+bool VideoFile::hasFrame() const {
+    return has_frame_;
+}
+
+bool VideoFile::isGLOutput() const {
+    return impl_->gl_output;
+}
+
 void VideoFile::update() {
-    g_main_context_iteration(g_main_loop_get_context(impl_->loop), false);
+    processBusEvents();
 
     if (impl_->end_of_stream) {
         pause(true);
         return;
     }
 
-    if (duration_ == 0) {
-        // Query the duration
-        gint64 duration_ns = GST_CLOCK_TIME_NONE;
-        if (gst_element_query_duration(impl_->pipeline, GST_FORMAT_TIME, &duration_ns)) {
-            duration_ = duration_ns * 1e-9;
-        }
+    if (is_paused_ && !impl_->wait_for_next_frame) {
+        prefetchFrames();
     }
 
-    gint64 position_ns = GST_CLOCK_TIME_NONE;
-    if (gst_element_query_position(impl_->pipeline, GST_FORMAT_TIME, &position_ns)) {
-        position_ = position_ns * 1e-9;
+    FrameRing::Frame frame;
+    while (impl_->frame_ring.pop(frame)) {
+        impl_->pending_frames.push_back(frame);
+    }
+
+    // while playing, the frame shown is the one due on screen once this update is swapped in,
+    // while paused or waiting for a seek it's simply the latest one
+    impl_->update_time = std::chrono::steady_clock::now();
+    int64_t present_time = getPresentTime();
+    FrameRing::Frame latest_frame;
+    while (!impl_->pending_frames.empty() &&
+           (present_time < 0 || impl_->pending_frames.front().running_time <= present_time))
+    {
+        if (latest_frame.buffer) {
+            gst_buffer_unref(latest_frame.buffer);
+            if (present_time >= 0) {
+                impl_->present_stats.dropped++;
+            }
+        }
+        latest_frame = impl_->pending_frames.front();
+        impl_->pending_frames.pop_front();
     }
 
-    if (impl_->new_frame) {
-        impl_->new_frame = false;
+    if (latest_frame.buffer) {
+        impl_->unpresented_arrival = latest_frame.arrival;
+        if (present_time >= 0) {
+            impl_->present_stats.presented++;
+            // the frame after it should already be on screen, it wasn't decoded in time
+            if (latest_frame.running_end >= 0 && present_time >= latest_frame.running_end) {
+                impl_->present_stats.late++;
+            }
+        }
+
+        cache_served_ = false;
+        displayed_pts_ = latest_frame.pts;
+        // the position is the frame on screen, not wherever the pipeline has got to
+        if (latest_frame.pts >= 0) {
+            position_ = latest_frame.pts * 1e-9;
+        }
+
+        // the duration is known once there's a frame, unless it changed since
+        if (!duration_queried_) {
+            gint64 duration_ns = GST_CLOCK_TIME_NONE;
+            if (gst_element_query_duration(impl_->pipeline, GST_FORMAT_TIME, &duration_ns)) {
+                duration_ = duration_ns * 1e-9;
+                duration_queried_ = true;
+            }
+        }
+
+        if (impl_->timing_open) {
+            impl_->timing_open = false;
+            std::chrono::duration<double, std::milli> latency =
+                std::chrono::steady_clock::now() - impl_->open_start;
+            size_t& opens = impl_->open_pooled ? open_stats.pooled_opens : open_stats.cold_opens;
+            double& mean_ms = impl_->open_pooled ? open_stats.pooled_mean_ms
+                                                 : open_stats.cold_mean_ms;
+            opens++;
+            mean_ms += (latency.count() - mean_ms) / opens;
+            open_stats.last_ms = latency.count();
+            open_stats.last_pooled = impl_->open_pooled;
+        }
 
         if (impl_->wait_for_next_frame) {
             impl_->wait_for_next_frame = false;
+            if (impl_->timing_seek) {
+                impl_->timing_seek = false;
+                std::chrono::duration<double, std::milli> latency =
+                    std::chrono::steady_clock::now() - impl_->seek_start;
+                impl_->seek_latencies.push_back(latency.count());
+                if (impl_->seek_latencies.size() > SEEK_LATENCY_HISTORY) {
+                    impl_->seek_latencies.pop_front();
+                }
+            }
             if (is_paused_) {
                 pause(true);
             }
-            setDirection(true);
-        }
-
-        auto frame = impl_->frame_buffer.back();
-        auto v_meta = gst_buffer_get_video_meta(frame);
-        GstVideoInfo v_info;
-        gst_video_info_set_format(&v_info, v_meta->format, v_meta->width,
-            v_meta->height);
-        width_ = v_meta->width;
-        height_ = v_meta->height;
-
-        GstMapInfo map;
-        if (!gst_buffer_map(frame, &map, GST_MAP_READ)) {
-            spdlog::error("Failed to map GstBuffer!");
-            return;
+            // only a reverse step leaves the pipeline playing backwards when it shouldn't
+            if (!impl_->is_forward && impl_->rate > 0) {
+                setDirection(true);
+            }
         }
 
-        if (texture_id_ == 0) {
-            glGenTextures(1, &texture_id_);
+        // decrement reference counts of expired frames, always keeping the displayed one
+        impl_->frame_buffer.push_back(latest_frame.buffer);
+        impl_->frame_buffer_bytes += gst_buffer_get_size(latest_frame.buffer);
+        while (impl_->frame_buffer.size() > 1 &&
+               (impl_->frame_buffer_bytes > impl_->frame_memory ||
+                (impl_->gl_output && impl_->frame_buffer.size() > GL_FRAME_BUFFER_SIZE)))
+        {
+            impl_->frame_buffer_bytes -= gst_buffer_get_size(impl_->frame_buffer.front());
+            gst_buffer_unref(impl_->frame_buffer.front());
+            impl_->frame_buffer.pop_front();
         }
 
-        glBindTexture(GL_TEXTURE_2D, texture_id_);
+        width_ = latest_frame.width;
+        height_ = latest_frame.height;
 
-        // Set texture parameters (filtering, wrapping)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (impl_->gl_output) {
+            showGLFrame(latest_frame.buffer);
+        }
+        else {
+            uploadFrame(latest_frame.buffer, latest_frame.format, width_, height_);
+        }
+        has_frame_ = true;
+
+        auto& stats = impl_->resolution_stats[{width_, height_}];
+        stats.width = width_;
+        stats.height = height_;
+        stats.frames++;
+        stats.convert_ms += impl_->convert_ms;
+        if (!impl_->upload_times.empty()) {
+            stats.upload_ms += impl_->upload_times.back();
+        }
+        if (!is_paused_) {
+            stats.playing_frames++;
+        }
+    }
 
-        // Upload pixel data to the GPU
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width_, height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, map.data);
+    // frame rates only count while playing, stepping and seeking would skew them
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - impl_->last_update;
+    if (!is_paused_ && width_ > 0) {
+        impl_->resolution_stats[{width_, height_}].playing_seconds += elapsed.count();
+    }
+    // the decoder is busy while playing and while a seek waits for its frame
+    if (!is_paused_ || impl_->wait_for_next_frame) {
+        impl_->profile_seconds[profile_index(impl_->active_profile)] += elapsed.count();
+    }
+    impl_->last_update = now;
 
-        gst_buffer_unmap(frame, &map);
+    if (impl_->display_size_pending && now - impl_->display_size_changed > DISPLAY_SIZE_DEBOUNCE) {
+        impl_->display_size_pending = false;
+        applyOutputSize();
+    }
 
-        // Unbind the texture
-        glBindTexture(GL_TEXTURE_2D, 0);
+    // whatever was requested while the pipeline was busy is executed now, only the latest of it
+    if (!impl_->wait_for_next_frame && pending_command_.type != CommandType::NONE) {
+        execute();
     }
 }
 
-bool VideoFile::isPaused() const {
-    return is_paused_;
-}
+void VideoFile::processBusEvents() {
+    std::deque<BusEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(impl_->bus_mutex);
+        events.swap(impl_->bus_events);
+    }
 
-void VideoFile::play() {
-    pause(false);
+    for (auto event: events) {
+        if (event == BusEvent::END_OF_STREAM) {
+            // frames decoded after this point are dropped until the next seek
+            if (impl_->is_forward) {
+                impl_->end_of_stream = true;
+            }
+
+            auto seek_event = gst_event_new_seek (1, GST_FORMAT_TIME,
+                GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE), GST_SEEK_TYPE_SET,
+                0, GST_SEEK_TYPE_END, 0);
+            gst_element_send_event(impl_->pipeline, seek_event);
+
+            bool was_reversing = impl_->rate < 0;
+            impl_->rate = 1.0;
+            if (impl_->is_forward) {
+                gst_element_set_state(impl_->pipeline, GST_STATE_PAUSED);
+            }
+            else {
+                impl_->is_forward = true;
+                // playing backwards stops at the start, rather than turning around
+                if (was_reversing) {
+                    pause(true);
+                }
+            }
+        }
+        else if (event == BusEvent::DURATION_CHANGED) {
+            duration_queried_ = false;
+        }
+        else if (event == BusEvent::ERROR) {
+            // no frame is coming, so commands mustn't keep waiting for one
+            impl_->wait_for_next_frame = false;
+            impl_->failed = true;
+        }
+    }
 }
 
-void VideoFile::stop() {
+void VideoFile::showCachedFrame(FrameCache::Frame& frame) {
+    impl_->seek_stats.cache_hits++;
+    uploadFrame(frame.buffer, frame.format, frame.width, frame.height);
+    gst_buffer_unref(frame.buffer);
+    frame.buffer = nullptr;
+
+    width_ = frame.width;
+    height_ = frame.height;
+    displayed_pts_ = frame.pts;
+    position_ = frame.pts * 1e-9;
+    cache_served_ = true;
+    has_frame_ = true;
+    impl_->end_of_stream = false;
 }
 
-void VideoFile::pause(bool is_paused) {
-    // don't unpause if the end of the stream has been reached
-    if (!is_paused && impl_->end_of_stream) {
+void VideoFile::uploadFrame(GstBuffer* frame, int format, int width, int height) {
+    auto start = std::chrono::steady_clock::now();
+
+    // the mapped frame describes the planes with the strides the decoder actually used
+    GstVideoInfo info;
+    GstVideoFrame video_frame;
+    if (!gst_video_info_set_format(&info, static_cast<GstVideoFormat>(format), width, height) ||
+        !gst_video_frame_map(&video_frame, &info, frame, GST_MAP_READ))
+    {
+        spdlog::error("Failed to map GstBuffer!");
         return;
     }
 
-    is_paused_ = is_paused;
-    if (is_paused) {
-        if (!impl_->wait_for_next_frame) {
-            gst_element_set_state(impl_->pipeline, GST_STATE_PAUSED);
+    if (!impl_->pixel_buffers_checked) {
+        impl_->pixel_buffers_checked = true;
+        impl_->pixel_buffers_supported = has_pixel_buffer_objects();
+        if (!impl_->pixel_buffers_supported) {
+            spdlog::warn("Pixel buffer objects aren't supported, uploading frames directly.");
         }
     }
-    else {
-        gst_element_set_state(impl_->pipeline, GST_STATE_PLAYING);
-        impl_->wait_for_next_frame = false;
-        last_seek_ = -1;
-        next_seek_ = -1;
+
+    if (texture_id_ == 0) {
+        glGenTextures(1, &texture_id_);
     }
-}
 
-void VideoFile::seek(double position) {
+    // only a change of resolution reallocates the texture, every other frame updates it in place
+    if (width != impl_->texture_width || height != impl_->texture_height) {
+        glBindTexture(GL_TEXTURE_2D, texture_id_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        impl_->texture_width = width;
+        impl_->texture_height = height;
+    }
+
+    if (format == GST_VIDEO_FORMAT_RGBA) {
+        uploadPlane(texture_id_, video_frame, 0, GL_RGBA, 4);
+    }
+    else if (impl_->yuv_converter && impl_->yuv_converter->prepare(info)) {
+        for (guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&video_frame); plane++) {
+            bool is_interleaved = format == GST_VIDEO_FORMAT_NV12 && plane == 1;
+            uploadPlane(impl_->yuv_converter->getPlaneTexture(plane), video_frame, plane,
+                        is_interleaved ? GL_RG : GL_RED, is_interleaved ? 2 : 1);
+        }
+        impl_->yuv_converter->convert(info, texture_id_);
+    }
+    else {
+        spdlog::error("Can't display frames in {}.", gst_video_format_to_string(
+            static_cast<GstVideoFormat>(format)));
+    }
+
+    gst_video_frame_unmap(&video_frame);
+
+    std::chrono::duration<double, std::milli> upload_time =
+        std::chrono::steady_clock::now() - start;
+    impl_->uploads++;
+    impl_->upload_times.push_back(upload_time.count());
+    if (impl_->upload_times.size() > UPLOAD_TIME_HISTORY) {
+        impl_->upload_times.pop_front();
+    }
+}
+
+void VideoFile::uploadPlane(uint32_t texture_id, const GstVideoFrame& frame, int plane,
+                            uint32_t gl_format, int pixel_size)
+{
+    int width = GST_VIDEO_FRAME_COMP_WIDTH(&frame, plane);
+    int height = GST_VIDEO_FRAME_COMP_HEIGHT(&frame, plane);
+    int stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, plane);
+    auto data = static_cast<const uint8_t*>(GST_VIDEO_FRAME_PLANE_DATA(&frame, plane));
+    size_t size = static_cast<size_t>(stride) * (height - 1) + width * pixel_size;
+
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / pixel_size);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    bool uploaded = false;
+    if (impl_->use_pixel_buffers && impl_->pixel_buffers_supported) {
+        if (impl_->pixel_buffers[0] == 0) {
+            glGenBuffers(PIXEL_BUFFER_COUNT, impl_->pixel_buffers);
+        }
+
+        // the copy into the buffer is the only work done on this thread, the transfer into the
+        // texture is queued and runs while the frame is rendered.  Orphaning the buffer's storage
+        // keeps the driver from waiting for a transfer that still reads from it.
+        impl_->pixel_buffer_index = (impl_->pixel_buffer_index + 1) % PIXEL_BUFFER_COUNT;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, impl_->pixel_buffers[impl_->pixel_buffer_index]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        void* pixels = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if (pixels) {
+            std::memcpy(pixels, data, size);
+            if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, gl_format,
+                                GL_UNSIGNED_BYTE, nullptr);
+                uploaded = true;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    if (!uploaded) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, gl_format, GL_UNSIGNED_BYTE, data);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VideoFile::showGLFrame(GstBuffer* frame) {
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, GST_VIDEO_FORMAT_RGBA, width_, height_);
+
+    GstVideoFrame video_frame;
+    if (!gst_video_frame_map(&video_frame, &info, frame,
+                             GstMapFlags(GST_MAP_READ | GST_MAP_GL)))
+    {
+        spdlog::error("Failed to map GL frame!");
+        return;
+    }
+    impl_->gl_texture = *static_cast<guint*>(video_frame.data[0]);
+
+    // the texture is written by GStreamer's own context, wait until that's done before drawing it
+    GstGLSyncMeta* sync_meta = gst_buffer_get_gl_sync_meta(frame);
+    if (sync_meta) {
+        gst_gl_sync_meta_wait(sync_meta, gl_app_context);
+    }
+    gst_video_frame_unmap(&video_frame);
+
+    impl_->uploads++;
+}
+
+void VideoFile::setPixelBufferUpload(bool enabled) {
+    impl_->use_pixel_buffers = enabled;
+    impl_->upload_times.clear();
+}
+
+bool VideoFile::isPixelBufferUpload() const {
+    return impl_->use_pixel_buffers && (impl_->pixel_buffers_supported ||
+                                        !impl_->pixel_buffers_checked);
+}
+
+void VideoFile::presented() {
+    std::chrono::duration<double, std::milli> delay =
+        std::chrono::steady_clock::now() - impl_->update_time;
+    impl_->present_stats.delay_ms +=
+        (std::min(delay.count(), MAX_PRESENT_DELAY_MS) - impl_->present_stats.delay_ms) * 0.1;
+
+    if (impl_->unpresented_arrival >= 0) {
+        double latency_ms = (steady_time_ns() - impl_->unpresented_arrival) * 1e-6;
+        impl_->unpresented_arrival = -1;
+        impl_->present_latencies.push_back(latency_ms);
+        if (impl_->present_latencies.size() > PRESENT_LATENCY_HISTORY) {
+            impl_->present_latencies.pop_front();
+        }
+    }
+}
+
+PresentStats VideoFile::getPresentStats() const {
+    PresentStats stats = impl_->present_stats;
+    if (!impl_->present_latencies.empty()) {
+        double total = 0;
+        stats.latency_max_ms = 0;
+        for (auto latency: impl_->present_latencies) {
+            total += latency;
+            stats.latency_max_ms = std::max(stats.latency_max_ms, latency);
+        }
+        stats.latency_mean_ms = total / impl_->present_latencies.size();
+        stats.latency_last_ms = impl_->present_latencies.back();
+    }
+
+    return stats;
+}
+
+int64_t VideoFile::getPresentTime() const {
+    if (is_paused_ || impl_->wait_for_next_frame) {
+        return -1;
+    }
+
+    GstClock* clock = gst_element_get_clock(impl_->pipeline);
+    if (!clock) {
+        return -1;
+    }
+    GstClockTime now = gst_clock_get_time(clock);
+    gst_object_unref(clock);
+    GstClockTime base_time = gst_element_get_base_time(impl_->pipeline);
+    if (now < base_time) {
+        return -1;
+    }
+
+    auto delay_ns = static_cast<int64_t>(impl_->present_stats.delay_ms * 1e6);
+    return static_cast<int64_t>(now - base_time) + delay_ns;
+}
+
+void VideoFile::discardPendingFrames() {
+    impl_->frame_ring.clear();
+    for (auto& frame: impl_->pending_frames) {
+        gst_buffer_unref(frame.buffer);
+    }
+    impl_->pending_frames.clear();
+}
+
+UploadStats VideoFile::getUploadStats() const {
+    UploadStats stats;
+    stats.frames = impl_->uploads;
+    stats.dropped = impl_->frame_ring.getDropped();
+    if (!impl_->upload_times.empty()) {
+        double total = 0;
+        for (auto upload_time: impl_->upload_times) {
+            total += upload_time;
+            stats.max_ms = std::max(stats.max_ms, upload_time);
+        }
+        stats.mean_ms = total / impl_->upload_times.size();
+        stats.last_ms = impl_->upload_times.back();
+    }
+
+    return stats;
+}
+
+void VideoFile::prefetchFrames() {
+    int64_t frame_duration = impl_->frame_duration;
+    if (displayed_pts_ < 0 || frame_duration <= 0) {
+        return;
+    }
+
+    if (!impl_->prefetcher) {
+        const auto& caps = impl_->output_caps.empty() ? impl_->frame_caps : impl_->output_caps;
+        impl_->prefetcher = std::make_unique<FramePrefetcher>(impl_->uri, caps,
+                                                              impl_->frame_cache);
+    }
+
+    if (impl_->reverse_stepping) {
+        // fetch the previous GOP in the background before the cursor runs out of decoded frames
+        int64_t start = impl_->frame_cache->contiguousStart(displayed_pts_);
+        if (start < 0) {
+            start = displayed_pts_;
+        }
+        if (start > 0 && displayed_pts_ - start < PREFETCH_FRAMES * frame_duration &&
+            start != impl_->prefetch_gop_end)
+        {
+            impl_->prefetcher->request(start - frame_duration, start, true);
+            impl_->prefetch_gop_end = start;
+        }
+        return;
+    }
+
+    // start over once the cursor has moved through half of the window
+    if (impl_->prefetch_center >= 0 &&
+        std::abs(displayed_pts_ - impl_->prefetch_center) < PREFETCH_FRAMES / 2 * frame_duration)
+    {
+        return;
+    }
+
+    impl_->prefetcher->request(displayed_pts_ - PREFETCH_FRAMES * frame_duration,
+                               displayed_pts_ + (PREFETCH_FRAMES + 1) * frame_duration);
+    impl_->prefetch_center = displayed_pts_;
+}
+
+void VideoFile::setDisplaySize(int width, int height) {
+    if (width == impl_->display_width && height == impl_->display_height) {
+        return;
+    }
+
+    impl_->display_width = width;
+    impl_->display_height = height;
+    impl_->display_size_changed = std::chrono::steady_clock::now();
+    impl_->display_size_pending = true;
+}
+
+void VideoFile::setNativeResolution(bool native_resolution) {
+    if (native_resolution == impl_->native_resolution) {
+        return;
+    }
+
+    impl_->native_resolution = native_resolution;
+    applyOutputSize();
+}
+
+bool VideoFile::isNativeResolution() const {
+    return impl_->native_resolution;
+}
+
+std::vector<ResolutionStats> VideoFile::getResolutionStats() const {
+    std::vector<ResolutionStats> stats;
+    for (const auto& resolution_stats: impl_->resolution_stats) {
+        stats.push_back(resolution_stats.second);
+    }
+    return stats;
+}
+
+void VideoFile::setDecoderProfile(DecoderProfile profile) {
+    impl_->selected_profile = profile;
+    applyDecoderProfile(is_paused_ ? DecoderProfile::QUALITY : DecoderProfile::PLAYBACK);
+}
+
+DecoderProfile VideoFile::getDecoderProfile() const {
+    return impl_->selected_profile;
+}
+
+DecoderProfile VideoFile::getActiveDecoderProfile() const {
+    return impl_->active_profile;
+}
+
+std::vector<DecoderStats> VideoFile::getDecoderStats() const {
+    std::vector<DecoderStats> stats;
+    for (auto profile: {DecoderProfile::QUALITY, DecoderProfile::PLAYBACK, DecoderProfile::SCRUB}) {
+        DecoderStats profile_stats;
+        profile_stats.profile = profile;
+        profile_stats.frames = impl_->profile_frames[profile_index(profile)];
+        profile_stats.busy_seconds = impl_->profile_seconds[profile_index(profile)];
+        stats.push_back(profile_stats);
+    }
+    return stats;
+}
+
+void VideoFile::applyDecoderProfile(DecoderProfile automatic) {
+    DecoderProfile profile = impl_->selected_profile;
+    if (profile == DecoderProfile::AUTO) {
+        profile = automatic;
+    }
+    if (profile == impl_->active_profile) {
+        return;
+    }
+
+    impl_->active_profile = profile;
+    g_object_set(impl_->framesink, "qos", DECODER_SETTINGS[profile_index(profile)].qos, nullptr);
+    std::lock_guard<std::mutex> lock(impl_->decoder_mutex);
+    for (auto decoder: impl_->decoders) {
+        apply_decoder_settings(decoder, profile);
+    }
+}
+
+void VideoFile::applyOutputSize() {
+    if (!impl_->scalecaps) {
+        return;
+    }
+
+    GstPad* pad = gst_element_get_static_pad(impl_->videoscale, "sink");
+    GstCaps* source_caps = gst_pad_get_current_caps(pad);
+    gst_object_unref(pad);
+    GstVideoInfo source_info;
+    bool has_source_info = source_caps && gst_video_info_from_caps(&source_info, source_caps);
+    if (source_caps) {
+        gst_caps_unref(source_caps);
+    }
+    if (!has_source_info) {
+        // not negotiated yet, try again once the first frame is there
+        impl_->display_size_pending = true;
+        return;
+    }
+
+    // the output keeps the source's display aspect ratio with square pixels
+    int width = 0;
+    int height = 0;
+    double source_width = static_cast<double>(GST_VIDEO_INFO_WIDTH(&source_info)) *
+                          GST_VIDEO_INFO_PAR_N(&source_info) /
+                          std::max(1, GST_VIDEO_INFO_PAR_D(&source_info));
+    double source_height = GST_VIDEO_INFO_HEIGHT(&source_info);
+    if (!impl_->native_resolution && impl_->display_width > 0 && impl_->display_height > 0) {
+        double scale = std::max(impl_->display_width / source_width,
+                                impl_->display_height / source_height);
+        if (scale < 1.0) {
+            width = static_cast<int>(std::round(source_width * scale / 2)) * 2;
+            height = static_cast<int>(std::round(source_height * scale / 2)) * 2;
+        }
+    }
+
+    if (width == impl_->output_width && height == impl_->output_height) {
+        return;
+    }
+    // ignore small changes, renegotiating costs a frame decode
+    if (width > 0 && impl_->output_height > 0 &&
+        std::abs(height - impl_->output_height) < impl_->output_height * DISPLAY_SIZE_TOLERANCE)
+    {
+        return;
+    }
+
+    impl_->output_width = width;
+    impl_->output_height = height;
+    GstCaps* caps = gst_caps_from_string(impl_->frame_caps.c_str());
+    if (width > 0) {
+        gst_caps_set_simple(caps, "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+                            "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, nullptr);
+    }
+    spdlog::info("video output size: {}", width > 0 ? std::to_string(width) + "x" +
+                                                      std::to_string(height) : "native");
+    g_object_set(impl_->scalecaps, "caps", caps, nullptr);
+
+    // frames of the previous size are dropped, and the prefetcher restarted with the new caps
+    gchar* caps_string = gst_caps_to_string(caps);
+    impl_->output_caps = caps_string;
+    g_free(caps_string);
+    gst_caps_unref(caps);
+    impl_->prefetcher.reset();
+    impl_->prefetch_center = -1;
+    impl_->prefetch_gop_end = -1;
+    impl_->frame_cache->clear();
+
+    // while paused, the displayed frame is decoded again at the new size
+    if (is_paused_ && displayed_pts_ >= 0) {
+        last_seek_ = -1;
+        seek(displayed_pts_ * 1e-9);
+    }
+}
+
+void VideoFile::setFrameCacheSize(size_t bytes) {
+    impl_->frame_cache->setMaxBytes(bytes);
+}
+
+void VideoFile::setFrameMemory(size_t bytes) {
+    impl_->frame_memory = bytes;
+}
+
+FrameMemoryStats VideoFile::getFrameMemoryStats() const {
+    FrameMemoryStats stats;
+    stats.retained_frames = impl_->frame_buffer.size();
+    stats.retained_bytes = impl_->frame_buffer_bytes;
+    stats.budget_bytes = impl_->frame_memory;
+    stats.cache_frames = impl_->frame_cache->size();
+    stats.cache_bytes = impl_->frame_cache->getBytes();
+    stats.cache_max_bytes = impl_->frame_cache->getMaxBytes();
+    stats.allocations = impl_->frame_allocations;
+    return stats;
+}
+
+bool VideoFile::isPaused() const {
+    return is_paused_;
+}
+
+bool VideoFile::isIdle() const {
+    return is_paused_ && !impl_->wait_for_next_frame &&
+           pending_command_.type == CommandType::NONE && !impl_->display_size_pending;
+}
+
+void VideoFile::play() {
+    pause(false);
+}
+
+void VideoFile::stop() {
+}
+
+void VideoFile::pause(bool is_paused) {
+    // don't unpause if the end of the stream has been reached
+    if (!is_paused && impl_->end_of_stream) {
+        return;
+    }
+
+    // pausing after the frame of a scrub arrived keeps scrubbing fast until the drag ends
+    if (is_paused != is_paused_) {
+        applyDecoderProfile(is_paused ? DecoderProfile::QUALITY : DecoderProfile::PLAYBACK);
+    }
+    is_paused_ = is_paused;
+    impl_->cache_frames = is_paused;
+    if (is_paused) {
+        // stepping and the frame cache need the pipeline decoding every frame forwards, so
+        // pausing goes back to 1x at the frame on screen
+        if (impl_->rate != 1.0) {
+            impl_->rate = 1.0;
+            impl_->is_forward = true;
+            if (!impl_->wait_for_next_frame && displayed_pts_ >= 0) {
+                seekAtRate(displayed_pts_);
+                waitForFrame();
+                return;
+            }
+        }
+        if (!impl_->wait_for_next_frame) {
+            gst_element_set_state(impl_->pipeline, GST_STATE_PAUSED);
+        }
+    }
+    else {
+        if (impl_->prefetcher) {
+            impl_->prefetcher->cancel();
+        }
+        impl_->prefetch_center = -1;
+        impl_->prefetch_gop_end = -1;
+        impl_->reverse_stepping = false;
+
+        // steps only make sense while paused, a pending seek still applies
+        if (pending_command_.type == CommandType::STEP) {
+            pending_command_ = {};
+        }
+
+        // resume from the frame that was shown out of the cache, or at another rate
+        if ((cache_served_ || impl_->rate != 1.0) && displayed_pts_ >= 0) {
+            seekAtRate(displayed_pts_);
+            impl_->is_forward = impl_->rate > 0;
+            cache_served_ = false;
+        }
+
+        gst_element_set_state(impl_->pipeline, GST_STATE_PLAYING);
+        impl_->wait_for_next_frame = false;
+        last_seek_ = -1;
+    }
+}
+
+void VideoFile::setRate(double rate) {
+    if (rate == 0) {
+        return;
+    }
+    double speed = std::max(MIN_RATE, std::min(std::abs(rate), MAX_RATE));
+    rate = rate < 0 ? -speed : speed;
+    if (rate == impl_->rate) {
+        return;
+    }
+
+    // while paused, the rate applies once playing resumes
+    impl_->rate = rate;
+    if (!is_paused_) {
+        Command command;
+        command.type = CommandType::RATE;
+        schedule(command);
+    }
+}
+
+double VideoFile::getRate() const {
+    return impl_->rate;
+}
+
+bool VideoFile::seekAtRate(int64_t position_ns) {
+    double rate = impl_->rate;
+    auto flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE;
+    if (std::abs(rate) > MAX_DECODED_RATE) {
+        // the decoder only gets keyframes, and the sink shows them at their own timestamps, so
+        // the position stays exact
+        flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS |
+                GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
+    }
+
+    // playing backwards plays the segment from its stop to its start
+    bool result = false;
+    if (rate > 0) {
+        result = gst_element_seek(impl_->pipeline, rate, GST_FORMAT_TIME, GstSeekFlags(flags),
+                                  GST_SEEK_TYPE_SET, position_ns, GST_SEEK_TYPE_NONE,
+                                  GST_CLOCK_TIME_NONE);
+    }
+    else {
+        result = gst_element_seek(impl_->pipeline, rate, GST_FORMAT_TIME, GstSeekFlags(flags),
+                                  GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_SET, position_ns);
+    }
+
+    if (!result) {
+        spdlog::error("Failed to seek at rate {}.", rate);
+    }
+    else {
+        // the flush has gone through, frames still waiting belong to the previous segment and
+        // their running times would hold back the new ones
+        discardPendingFrames();
+    }
+    return result;
+}
+
+void VideoFile::seek(double position) {
+    Command command;
+    command.type = CommandType::SEEK;
+    command.position = position;
+    schedule(command);
+}
+
+void VideoFile::scrub(double position) {
+    Command command;
+    command.type = CommandType::SCRUB;
+    command.position = position;
+    schedule(command);
+}
+
+void VideoFile::step(bool forward) {
+    Command command;
+    command.type = CommandType::STEP;
+    command.forward = forward;
+    command.steps = 1;
+    schedule(command);
+}
+
+void VideoFile::seekRelative(double offset) {
+    // relative to where a pending seek is going to land, so that repeated presses accumulate
+    double position = position_;
+    if (pending_command_.type == CommandType::SEEK || pending_command_.type == CommandType::SCRUB) {
+        position = pending_command_.position;
+    }
+
+    seek(std::max(0.0, std::min(position + offset, duration_)));
+}
+
+void VideoFile::schedule(const Command& command) {
+    // consecutive steps in one direction add up, anything else replaces the pending command
+    if (command.type == CommandType::STEP && pending_command_.type == CommandType::STEP &&
+        pending_command_.forward == command.forward)
+    {
+        pending_command_.steps = std::min(pending_command_.steps + command.steps,
+                                          MAX_PENDING_STEPS);
+        impl_->seek_stats.coalesced++;
+    }
+    else if (command.type == CommandType::RATE && pending_command_.type == CommandType::SEEK) {
+        // the pending seek is at the latest rate already
+        impl_->seek_stats.coalesced++;
+    }
+    else {
+        if (pending_command_.type != CommandType::NONE) {
+            impl_->seek_stats.coalesced++;
+        }
+        pending_command_ = command;
+    }
+
+    // only one pipeline operation is in flight at a time, the rest waits for its frame in update()
+    if (!impl_->wait_for_next_frame) {
+        execute();
+    }
+}
+
+void VideoFile::execute() {
+    Command command = pending_command_;
+    pending_command_ = {};
+    switch (command.type) {
+        case CommandType::SEEK:
+            doSeek(command.position);
+            break;
+        case CommandType::SCRUB:
+            doScrub(command.position);
+            break;
+        case CommandType::STEP:
+            // steps that couldn't be taken yet stay pending, unless another command came in
+            command.steps -= doStep(command.forward, command.steps);
+            if (command.steps > 0 && pending_command_.type == CommandType::NONE) {
+                pending_command_ = command;
+            }
+            break;
+        case CommandType::RATE:
+            doRate();
+            break;
+        case CommandType::NONE:
+            break;
+    }
+}
+
+void VideoFile::waitForFrame() {
+    gst_element_set_state(impl_->pipeline, GST_STATE_PLAYING);
+    impl_->wait_for_next_frame = true;
+    impl_->timing_seek = true;
+    impl_->seek_start = std::chrono::steady_clock::now();
+    impl_->seek_stats.pipeline_seeks++;
+}
+
+void VideoFile::doSeek(double position) {
+    // the final seek of a drag brings back full quality
+    applyDecoderProfile(is_paused_ ? DecoderProfile::QUALITY : DecoderProfile::PLAYBACK);
+
     // ignore seeks to the end if the end of stream has already been reached
     if (impl_->end_of_stream && position >= duration_) {
         return;
     }
 
-    // wait for existing seeking to be done
-    if (impl_->wait_for_next_frame && !impl_->end_of_stream) {
-        next_seek_ = position;
+    // ignore repeat seeks to the same position
+    if (position == last_seek_ && !impl_->end_of_stream) {
         return;
     }
 
-    // ignore repeat seeks to the same position
+    // accurate seeks land on the start of the frame the position falls into, so that they're
+    // found in the frame cache, and repeat seeks within a frame are recognized as such
+    position = snapToFrame(std::max(0.0, std::min(duration_, position)));
     if (position == last_seek_ && !impl_->end_of_stream) {
         return;
     }
 
-    position = std::max(0.0, std::min(duration_, position));
+    // frames that have already been decoded are shown without touching the pipeline
+    FrameCache::Frame frame;
+    if (is_paused_ && impl_->frame_cache->find(static_cast<int64_t>(std::round(position * 1e9)),
+                                               frame))
+    {
+        showCachedFrame(frame);
+        last_seek_ = position;
+        return;
+    }
 
     impl_->end_of_stream = false;
+    impl_->reverse_stepping = false;
+    impl_->prefetch_gop_end = -1;
+    cache_served_ = false;
 
+    // seeking while playing keeps the rate, which may have changed while the seek was pending
     gint64 position_ns = static_cast<gint64>(std::round(position * 1e9));
-    if (!gst_element_seek(impl_->pipeline, 1.0, GST_FORMAT_TIME,
-                          GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE),
-                          GST_SEEK_TYPE_SET, position_ns, GST_SEEK_TYPE_NONE,
-                          GST_CLOCK_TIME_NONE))
+    if (!seekAtRate(position_ns)) {
+        return;
+    }
+    impl_->is_forward = impl_->rate > 0;
+    waitForFrame();
+    last_seek_ = position;
+}
+
+void VideoFile::doScrub(double position) {
+    applyDecoderProfile(DecoderProfile::SCRUB);
+
+    position = std::max(0.0, std::min(duration_, position));
+    int64_t position_ns = static_cast<int64_t>(std::round(position * 1e9));
+
+    FrameCache::Frame frame;
+    if (is_paused_ && impl_->frame_cache->find(position_ns, frame)) {
+        showCachedFrame(frame);
+        last_seek_ = -1;
+        return;
+    }
+
+    // with the index, the seek targets the exact keyframe time and moving within the same GOP
+    // doesn't need a seek at all; without it, the demuxer has to find the keyframe itself
+    int64_t target = position_ns;
+    auto flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST;
+    int64_t keyframe = impl_->keyframe_index->keyframeNearest(position_ns);
+    if (keyframe >= 0) {
+        if (keyframe == impl_->scrub_target && !cache_served_) {
+            return;
+        }
+        target = keyframe;
+        flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT;
+    }
+
+    if (!gst_element_seek(impl_->pipeline, 1.0, GST_FORMAT_TIME, GstSeekFlags(flags),
+                          GST_SEEK_TYPE_SET, target, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE))
     {
         spdlog::error("Failed to seek.");
         return;
     }
-    gst_element_set_state(impl_->pipeline, GST_STATE_PLAYING);
-    impl_->wait_for_next_frame = true;
-    next_seek_ = -1;
-    last_seek_ = position;
+
+    impl_->scrub_target = target;
+    impl_->end_of_stream = false;
+    impl_->reverse_stepping = false;
+    impl_->prefetch_gop_end = -1;
+    cache_served_ = false;
+    waitForFrame();
+    // the accurate seek at the end of the drag must not be skipped as a repeat
+    last_seek_ = -1;
 }
 
-void VideoFile::seekRelative(double offset) {
-    gint64 position_ns = GST_CLOCK_TIME_NONE;
-    if (gst_element_query_position(impl_->pipeline, GST_FORMAT_TIME, &position_ns)) {
-        double seek_pos = position_ns / 1e9 + offset;
-        seek_pos = std::max(0.0, std::min(seek_pos, duration_));
-        seek(seek_pos);
+void VideoFile::doRate() {
+    // pausing, or the end of the stream, came in while the rate change was pending
+    if (is_paused_ || impl_->end_of_stream || displayed_pts_ < 0) {
+        return;
+    }
+
+    if (!seekAtRate(displayed_pts_)) {
+        return;
+    }
+    impl_->is_forward = impl_->rate > 0;
+    // the next rate change waits for the first frame at this one
+    waitForFrame();
+}
+
+int VideoFile::doStep(bool forward, int steps) {
+    applyDecoderProfile(is_paused_ ? DecoderProfile::QUALITY : DecoderProfile::PLAYBACK);
+
+    int64_t frame_duration = impl_->frame_duration;
+    if (is_paused_ && displayed_pts_ >= 0) {
+        impl_->reverse_stepping = !forward;
+
+        // walk through the cached frames, only the one landed on is uploaded
+        FrameCache::Frame frame;
+        int cached_steps = 0;
+        while (cached_steps < steps) {
+            FrameCache::Frame neighbour;
+            int64_t pts = frame.buffer ? frame.pts : displayed_pts_;
+            bool is_cached = forward ? impl_->frame_cache->next(pts, neighbour)
+                                     : impl_->frame_cache->previous(pts, neighbour);
+            if (!is_cached) {
+                break;
+            }
+            if (frame.buffer) {
+                gst_buffer_unref(frame.buffer);
+            }
+            frame = neighbour;
+            cached_steps++;
+        }
+        if (cached_steps > 0) {
+            showCachedFrame(frame);
+            return cached_steps;
+        }
+
+        // rather than a flushing negative rate seek, which is slow and not frame accurate for
+        // most codecs, wait for the enclosing GOP to be decoded forward into the cache
+        if (!forward && frame_duration > 0) {
+            // the steps are dropped if there's nothing earlier, at the first frame of the stream
+            // or once the GOP before the cached frames has been decoded without reaching back
+            int64_t start = impl_->frame_cache->contiguousStart(displayed_pts_);
+            if (start < 0) {
+                start = displayed_pts_;
+            }
+            bool is_exhausted = start <= 0 || (start == impl_->prefetch_gop_end &&
+                                               impl_->prefetcher && !impl_->prefetcher->isBusy());
+            if (!is_exhausted) {
+                prefetchFrames();
+                return 0;
+            }
+            return steps;
+        }
+
+        // the pipeline is still at the frame where the cache took over, so a step event would
+        // land on the wrong frame; seek to the middle of the target frame instead
+        if (cache_served_ && frame_duration > 0) {
+            double offset = forward ? steps + 0.5 : 0.5 - steps;
+            doSeek(std::max(0.0, (displayed_pts_ + offset * frame_duration) * 1e-9));
+            return steps;
+        }
+    }
+
+    if (!forward && position_ <= 0.2) {
+        doSeek(0);
+        if (!impl_->wait_for_next_frame) {
+            waitForFrame();
+        }
+        return steps;
     }
+
+    if (forward && position_ >= duration_) {
+        return steps;
+    }
+
+    if (!forward) {
+        setDirection(false);
+    }
+
+    // create and send step event, covering all of the pending steps at once
+    GstEvent* step_event = gst_event_new_step(GST_FORMAT_BUFFERS, steps, 1, TRUE, FALSE);
+    gst_element_send_event(impl_->pipeline, step_event);
+
+    waitForFrame();
+    return steps;
 }
 
 void VideoFile::setDirection(bool forward) {
@@ -339,32 +1939,76 @@ void VideoFile::setDirection(bool forward) {
     impl_->is_forward = forward;
 }
 
-void VideoFile::step(bool forward) {
-    if (!forward && position_ <= 0.2) {
-        seek(0);
-        gst_element_set_state(impl_->pipeline, GST_STATE_PLAYING);
-        impl_->wait_for_next_frame = true;
-        return;
+SeekStats VideoFile::getSeekStats() const {
+    SeekStats stats = impl_->seek_stats;
+    if (!impl_->seek_latencies.empty()) {
+        double total = 0;
+        for (auto latency: impl_->seek_latencies) {
+            total += latency;
+            stats.max_ms = std::max(stats.max_ms, latency);
+        }
+        stats.mean_ms = total / impl_->seek_latencies.size();
+        stats.last_ms = impl_->seek_latencies.back();
     }
 
-    if (forward && position_ >= duration_) {
-        return;
+    return stats;
+}
+
+double VideoFile::getPosition() const {
+    return position_;
+}
+
+int64_t VideoFile::getFrameCount() const {
+    size_t frame_count = impl_->keyframe_index->frameCount();
+    if (frame_count > 0) {
+        return static_cast<int64_t>(frame_count);
     }
 
-    if (!forward) {
-        setDirection(false);
+    int64_t frame_duration = impl_->frame_duration;
+    if (frame_duration <= 0 || duration_ <= 0) {
+        return 0;
     }
+    return static_cast<int64_t>(std::ceil(duration_ * 1e9 / frame_duration));
+}
 
-    // create and send step event
-    GstEvent* step_event = gst_event_new_step(GST_FORMAT_BUFFERS, 1, 1, TRUE, FALSE);
-    gst_element_send_event(impl_->pipeline, step_event);
+int64_t VideoFile::getFrameNumber(double time) const {
+    int64_t time_ns = static_cast<int64_t>(std::round(time * 1e9)) + FRAME_TIME_TOLERANCE;
+    int64_t frame = impl_->keyframe_index->frameAt(time_ns);
+    if (frame >= 0) {
+        return frame;
+    }
 
-    gst_element_set_state(impl_->pipeline, GST_STATE_PLAYING);
-    impl_->wait_for_next_frame = true;
+    // estimated from the frame rate until the index is ready
+    int64_t frame_duration = impl_->frame_duration;
+    if (frame_duration <= 0) {
+        return -1;
+    }
+    return std::max<int64_t>(0, time_ns / frame_duration);
 }
 
-double VideoFile::getPosition() const {
-    return position_;
+double VideoFile::getFrameTime(int64_t frame) const {
+    int64_t time_ns = impl_->keyframe_index->frameTime(frame);
+    if (time_ns >= 0) {
+        return time_ns * 1e-9;
+    }
+    if (impl_->keyframe_index->frameCount() > 0) {
+        return -1;
+    }
+
+    int64_t frame_duration = impl_->frame_duration;
+    if (frame_duration <= 0 || frame < 0) {
+        return -1;
+    }
+    return frame * frame_duration * 1e-9;
+}
+
+double VideoFile::snapToFrame(double time) const {
+    double frame_time = getFrameTime(getFrameNumber(time));
+    return frame_time >= 0 ? frame_time : time;
+}
+
+int64_t VideoFile::getDisplayedFrame() const {
+    return getFrameNumber(position_);
 }
 
 bool VideoFile::exiting() {
@@ -0,0 +1,184 @@
+#include <just_annotate/video_queue.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+namespace just_annotate {
+
+const std::set<std::string> VIDEO_EXTENSIONS = {".mp4", ".ts"};
+// entries after the current one that are kept prerolled
+const size_t PREROLL_COUNT = 2;
+// a prerolled video only needs its first frame until it becomes the current one
+const size_t PREROLL_FRAME_CACHE_SIZE = 16 << 20;
+
+VideoQueue::VideoQueue(const HashCache::Ptr& hash_cache) : hash_worker_(hash_cache) {
+}
+
+VideoQueue::Ptr VideoQueue::open(const std::string& path, const HashCache::Ptr& hash_cache) {
+    auto queue = std::make_shared<VideoQueue>(hash_cache);
+    queue->path_ = path;
+
+    std::error_code ec;
+    if (fs::is_directory(path, ec)) {
+        for (const auto& entry: fs::directory_iterator(path, ec)) {
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            if (entry.is_regular_file(ec) && VIDEO_EXTENSIONS.count(extension) != 0) {
+                queue->entries_.push_back(entry.path().string());
+            }
+        }
+        std::sort(queue->entries_.begin(), queue->entries_.end());
+    }
+    else {
+        std::ifstream infile(path);
+        if (!infile.is_open()) {
+            spdlog::error("Failed to open video queue: {}", path);
+            return {};
+        }
+
+        fs::path list_dir = fs::path(path).parent_path();
+        std::string line;
+        while (std::getline(infile, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            fs::path entry_path(line);
+            if (entry_path.is_relative()) {
+                entry_path = list_dir / entry_path;
+            }
+            queue->entries_.push_back(entry_path.lexically_normal().string());
+        }
+    }
+
+    if (queue->entries_.empty()) {
+        spdlog::error("No videos to queue in: {}", path);
+        return {};
+    }
+
+    spdlog::info("Queued {} videos from {}", queue->entries_.size(), path);
+    return queue;
+}
+
+const std::string& VideoQueue::getPath() const {
+    return path_;
+}
+
+size_t VideoQueue::size() const {
+    return entries_.size();
+}
+
+const std::string& VideoQueue::getEntry(size_t index) const {
+    return entries_[index];
+}
+
+int VideoQueue::getIndex() const {
+    return index_;
+}
+
+bool VideoQueue::isPrerolled(size_t index) const {
+    auto prerolled_it = prerolled_.find(index);
+    return prerolled_it != prerolled_.end() && prerolled_it->second &&
+           prerolled_it->second->hasFrame();
+}
+
+bool VideoQueue::isPrerolling() const {
+    size_t first = static_cast<size_t>(index_ + 1);
+    size_t last = std::min(first + PREROLL_COUNT, entries_.size());
+    for (size_t index = first; index < last; index++) {
+        auto prerolled_it = prerolled_.find(index);
+        if (prerolled_it == prerolled_.end() ||
+            (prerolled_it->second && !prerolled_it->second->hasFrame()))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+VideoFile::Ptr VideoQueue::take(const std::string& path) {
+    auto entry_it = std::find(entries_.begin(), entries_.end(), path);
+    if (entry_it == entries_.end()) {
+        return {};
+    }
+
+    index_ = static_cast<int>(std::distance(entries_.begin(), entry_it));
+
+    // the current video is hashed in the foreground, with its progress shown
+    if (hash_worker_.isBusy() && hash_worker_.getPath() == path) {
+        hash_worker_.cancel();
+        hashed_.erase(path);
+    }
+
+    auto prerolled_it = prerolled_.find(index_);
+    if (prerolled_it == prerolled_.end()) {
+        return {};
+    }
+
+    // a video that is still prerolling is handed over as well, it's further along than a new one
+    auto video_file = prerolled_it->second;
+    prerolled_.erase(prerolled_it);
+    return video_file;
+}
+
+void VideoQueue::update(const VideoOptions& options, const std::set<std::string>& algorithms,
+                        bool can_hash)
+{
+    // moving through the queue releases the videos that dropped out of the window
+    for (auto prerolled_it = prerolled_.begin(); prerolled_it != prerolled_.end();) {
+        int index = static_cast<int>(prerolled_it->first);
+        if (index <= index_ || index > index_ + static_cast<int>(PREROLL_COUNT)) {
+            prerolled_it = prerolled_.erase(prerolled_it);
+        }
+        else {
+            ++prerolled_it;
+        }
+    }
+
+    size_t first = static_cast<size_t>(index_ + 1);
+    size_t last = std::min(first + PREROLL_COUNT, entries_.size());
+    for (size_t index = first; index < last; index++) {
+        auto prerolled_it = prerolled_.find(index);
+        if (prerolled_it == prerolled_.end()) {
+            // one video is opened per update, so that a frame never waits on several of them
+            auto video_file = VideoFile::open(entries_[index], options);
+            if (video_file) {
+                video_file->setFrameCacheSize(PREROLL_FRAME_CACHE_SIZE);
+            }
+            else {
+                spdlog::warn("Failed to preroll video: {}", entries_[index]);
+            }
+            prerolled_[index] = video_file;
+            break;
+        }
+
+        // the pipeline pauses itself once the first frame has been uploaded
+        if (prerolled_it->second && !prerolled_it->second->hasFrame()) {
+            prerolled_it->second->update();
+        }
+    }
+
+    HashWorker::Result result;
+    if (hash_worker_.poll(result) && result.hashes.empty() && !result.cancelled) {
+        spdlog::warn("Failed to hash queued video: {}", result.path);
+    }
+    if (can_hash && !hash_worker_.isBusy()) {
+        for (size_t index = first; index < last; index++) {
+            if (hashed_.insert(entries_[index]).second) {
+                hash_worker_.start(entries_[index], algorithms);
+                break;
+            }
+        }
+    }
+}
+
+} // namespace just_annotate
@@ -0,0 +1,266 @@
+#include <just_annotate/yuv_converter.h>
+
+#include <cstdio>
+#include <cstring>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <gst/video/video.h>
+#include <spdlog/spdlog.h>
+
+namespace just_annotate {
+
+const char* YUV_VERTEX_SHADER = R"(
+#version 120
+void main() {
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+    gl_Position = gl_Vertex;
+}
+)";
+
+// the chroma planes are sampled with linear filtering, which upsamples them to the luma resolution
+const char* YUV_FRAGMENT_SHADER = R"(
+#version 120
+uniform sampler2D plane0;
+uniform sampler2D plane1;
+uniform sampler2D plane2;
+uniform bool interleaved;
+uniform vec3 offset;
+uniform mat3 coefficients;
+void main() {
+    vec2 uv = gl_TexCoord[0].st;
+    vec3 yuv;
+    yuv.x = texture2D(plane0, uv).r;
+    if (interleaved) {
+        yuv.yz = texture2D(plane1, uv).rg;
+    }
+    else {
+        yuv.y = texture2D(plane1, uv).r;
+        yuv.z = texture2D(plane2, uv).r;
+    }
+    gl_FragColor = vec4(clamp(coefficients * (yuv + offset), 0.0, 1.0), 1.0);
+}
+)";
+
+GLuint compile_shader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        char log[1024] = {};
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        spdlog::error("Failed to compile YUV conversion shader: {}", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+YuvConverter::~YuvConverter() {
+    if (program_ != 0) {
+        glDeleteProgram(program_);
+    }
+    if (framebuffer_ != 0) {
+        glDeleteFramebuffers(1, &framebuffer_);
+    }
+    if (plane_textures_[0] != 0) {
+        glDeleteTextures(3, plane_textures_);
+    }
+}
+
+bool YuvConverter::isSupported() {
+    // shaders are core since 2.0, framebuffer objects and single and two channel textures since 3.0
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    int major = 0;
+    int minor = 0;
+    if (version && sscanf(version, "%d.%d", &major, &minor) == 2 && major >= 3) {
+        return true;
+    }
+
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    return major >= 2 && extensions && strstr(extensions, "GL_ARB_framebuffer_object") &&
+           strstr(extensions, "GL_ARB_texture_rg");
+}
+
+bool YuvConverter::isSupportedFormat(int format) {
+    return format == GST_VIDEO_FORMAT_NV12 || format == GST_VIDEO_FORMAT_I420;
+}
+
+bool YuvConverter::prepare(const GstVideoInfo& info) {
+    if (failed_ || !isSupportedFormat(GST_VIDEO_INFO_FORMAT(&info))) {
+        return false;
+    }
+    if (program_ == 0 && !createProgram()) {
+        failed_ = true;
+        return false;
+    }
+
+    if (plane_textures_[0] == 0) {
+        glGenTextures(3, plane_textures_);
+    }
+
+    format_ = GST_VIDEO_INFO_FORMAT(&info);
+    for (guint plane = 0; plane < GST_VIDEO_INFO_N_PLANES(&info); plane++) {
+        // in both formats, the plane's first component is the one with the plane's index
+        int width = GST_VIDEO_INFO_COMP_WIDTH(&info, plane);
+        int height = GST_VIDEO_INFO_COMP_HEIGHT(&info, plane);
+        if (width == plane_widths_[plane] && height == plane_heights_[plane]) {
+            continue;
+        }
+
+        bool is_interleaved = format_ == GST_VIDEO_FORMAT_NV12 && plane == 1;
+        glBindTexture(GL_TEXTURE_2D, plane_textures_[plane]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, is_interleaved ? GL_RG8 : GL_R8, width, height, 0,
+                     is_interleaved ? GL_RG : GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        plane_widths_[plane] = width;
+        plane_heights_[plane] = height;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return true;
+}
+
+uint32_t YuvConverter::getPlaneTexture(int plane) const {
+    return plane_textures_[plane];
+}
+
+bool YuvConverter::convert(const GstVideoInfo& info, uint32_t texture_id) {
+    if (failed_ || program_ == 0) {
+        return false;
+    }
+
+    // default to the standard of the resolution if the stream doesn't say
+    gdouble kr = 0;
+    gdouble kb = 0;
+    if (!gst_video_color_matrix_get_Kr_Kb(info.colorimetry.matrix, &kr, &kb)) {
+        bool is_hd = GST_VIDEO_INFO_HEIGHT(&info) > 576;
+        gst_video_color_matrix_get_Kr_Kb(is_hd ? GST_VIDEO_COLOR_MATRIX_BT709
+                                               : GST_VIDEO_COLOR_MATRIX_BT601, &kr, &kb);
+    }
+    double kg = 1.0 - kr - kb;
+
+    bool is_full_range = info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255;
+    double luma_scale = is_full_range ? 1.0 : 255.0 / 219.0;
+    double chroma_scale = is_full_range ? 1.0 : 255.0 / 224.0;
+    float offset[3] = {is_full_range ? 0.0f : -16.0f / 255.0f, -128.0f / 255.0f,
+                       -128.0f / 255.0f};
+
+    // rows produce R, G and B from Y, Cb and Cr
+    float coefficients[9] = {
+        static_cast<float>(luma_scale), 0.0f,
+        static_cast<float>(chroma_scale * 2.0 * (1.0 - kr)),
+        static_cast<float>(luma_scale),
+        static_cast<float>(-chroma_scale * 2.0 * kb * (1.0 - kb) / kg),
+        static_cast<float>(-chroma_scale * 2.0 * kr * (1.0 - kr) / kg),
+        static_cast<float>(luma_scale),
+        static_cast<float>(chroma_scale * 2.0 * (1.0 - kb)), 0.0f};
+
+    if (framebuffer_ == 0) {
+        glGenFramebuffers(1, &framebuffer_);
+    }
+
+    GLint previous_framebuffer = 0;
+    GLint previous_viewport[4] = {};
+    GLint previous_program = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_framebuffer);
+    glGetIntegerv(GL_VIEWPORT, previous_viewport);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_id, 0);
+    bool is_complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (is_complete) {
+        glViewport(0, 0, GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info));
+        glUseProgram(program_);
+        glUniform1i(glGetUniformLocation(program_, "interleaved"),
+                    format_ == GST_VIDEO_FORMAT_NV12);
+        glUniform3fv(glGetUniformLocation(program_, "offset"), 1, offset);
+        glUniformMatrix3fv(glGetUniformLocation(program_, "coefficients"), 1, GL_TRUE,
+                           coefficients);
+
+        for (int plane = 2; plane >= 0; plane--) {
+            glActiveTexture(GL_TEXTURE0 + plane);
+            glBindTexture(GL_TEXTURE_2D, plane_textures_[plane]);
+        }
+
+        glDisable(GL_BLEND);
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+
+        // the first row of the planes ends up in the first row of the texture, as with uploads
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f);
+        glVertex2f(-1.0f, -1.0f);
+        glTexCoord2f(1.0f, 0.0f);
+        glVertex2f(1.0f, -1.0f);
+        glTexCoord2f(1.0f, 1.0f);
+        glVertex2f(1.0f, 1.0f);
+        glTexCoord2f(0.0f, 1.0f);
+        glVertex2f(-1.0f, 1.0f);
+        glEnd();
+
+        for (int plane = 2; plane >= 0; plane--) {
+            glActiveTexture(GL_TEXTURE0 + plane);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+    else {
+        spdlog::error("Failed to render into the video texture, disabling YUV conversion.");
+        failed_ = true;
+    }
+
+    glUseProgram(previous_program);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+    glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2],
+               previous_viewport[3]);
+
+    return is_complete;
+}
+
+bool YuvConverter::createProgram() {
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, YUV_VERTEX_SHADER);
+    GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, YUV_FRAGMENT_SHADER);
+    if (vertex_shader == 0 || fragment_shader == 0) {
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        return false;
+    }
+
+    program_ = glCreateProgram();
+    glAttachShader(program_, vertex_shader);
+    glAttachShader(program_, fragment_shader);
+    glLinkProgram(program_);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program_, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        char log[1024] = {};
+        glGetProgramInfoLog(program_, sizeof(log), nullptr, log);
+        spdlog::error("Failed to link YUV conversion shader: {}", log);
+        glDeleteProgram(program_);
+        program_ = 0;
+        return false;
+    }
+
+    glUseProgram(program_);
+    glUniform1i(glGetUniformLocation(program_, "plane0"), 0);
+    glUniform1i(glGetUniformLocation(program_, "plane1"), 1);
+    glUniform1i(glGetUniformLocation(program_, "plane2"), 2);
+    glUseProgram(0);
+
+    return true;
+}
+
+} // namespace just_annotate